@@ -1,35 +1,476 @@
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <list>
 #include <vector>
 #include "aiplayer.h"
 #include "chessboard.h"
+#include "perfcounters.h"
 
 using namespace std;
 
-AIPlayer::AIPlayer(int color, int search_depth)
+/*
+* Value of every figure on every square, positive for white and negative
+* for black, indexed by the type and color bits of the figure. Only
+* material so far, so all squares are worth the same.
+*/
+struct PieceSquareTable
+{
+	int values[0x18][64];
+};
+
+static constexpr PieceSquareTable makePieceSquareTable(void)
+{
+	const int figures[7] = {
+		0, PAWN_VALUE, ROOK_VALUE, KNIGHT_VALUE, BISHOP_VALUE, QUEEN_VALUE, KING_VALUE
+	};
+
+	PieceSquareTable table = {};
+	int figure = 0, pos = 0;
+
+	for(figure = PAWN; figure <= KING; figure++)
+	{
+		for(pos = 0; pos < 64; pos++)
+		{
+			table.values[figure][pos] = figures[figure];
+			table.values[SET_BLACK(figure)][pos] = -figures[figure];
+		}
+	}
+
+	return table;
+}
+
+static constexpr PieceSquareTable piece_square = makePieceSquareTable();
+
+/*
+* Moves the move with the given packed form to the front of the list.
+*/
+static void moveToFront(list<Move> & moves, uint16_t packed)
+{
+	for(list<Move>::iterator it = moves.begin(); it != moves.end(); ++it)
+	{
+		if((*it).pack() == packed) {
+			moves.splice(moves.begin(), moves, it);
+			break;
+		}
+	}
+}
+
+/*
+* Mate scores count plies from the root. In the transposition table they
+* count from the stored position, so they stay valid wherever it turns up.
+*/
+static int scoreToTable(int score, int ply)
+{
+	if(score > WIN_VALUE - MAX_PLY)
+		return score + ply;
+	if(score < -WIN_VALUE + MAX_PLY)
+		return score - ply;
+	return score;
+}
+
+static int scoreFromTable(int score, int ply)
+{
+	if(score > WIN_VALUE - MAX_PLY)
+		return score - ply;
+	if(score < -WIN_VALUE + MAX_PLY)
+		return score + ply;
+	return score;
+}
+
+AIPlayer::AIPlayer(int color, int search_depth, const char * shared_table)
  : ChessPlayer(color),
-   search_depth(search_depth)
+   search_depth(search_depth),
+   multipv(1),
+   seed(time(NULL) ^ (uintptr_t)this),
+   nodes(0),
+   node_limit(0),
+   clock_remaining(0),
+   clock_increment(0),
+   clock_moves_to_go(0),
+   timed(false),
+   time_up(false),
+   transpositions(TT_ENTRIES, shared_table),
+   evaluations(EVAL_CACHE_ENTRIES),
+   follow_pv(false),
+   stop(false),
+   ponder_timed(false),
+   pondering(false),
+   searching(false),
+   search_found(false)
 {
-	srand(time(NULL));
+	memset(excluded_moves, 0, sizeof(excluded_moves));
 }
 
 AIPlayer::~AIPlayer()
-{}
+{
+	stopPondering();
+	abortSearch();
+}
+
+bool AIPlayer::getMove(ChessBoard & board, Move & move)
+{
+	AnalysisLine line;
+
+	return getMove(board, move, line);
+}
+
+bool AIPlayer::getMove(ChessBoard & board, Move & move, AnalysisLine & line)
+{
+	vector<AnalysisLine> lines;
+
+	if(!getMove(board, move, lines))
+		return false;
+
+	line = lines[0];
+	return true;
+}
+
+bool AIPlayer::getMove(ChessBoard & board, Move & move, vector<AnalysisLine> & lines)
+{
+	abortSearch();
+
+	if(pondering)
+	{
+		// ponder hit, the running search is the one we need. In a game
+		// with a clock it deepens until our time is up, which starts now.
+		if(board.getKey(this->color) == ponder_key) {
+			if(ponder_timed) {
+				timer.start(clock_remaining, clock_increment, clock_moves_to_go);
+				timed = true;
+			}
+
+			ponder_thread.join();
+			pondering = false;
+
+			if(ponder_found) {
+				move = ponder_move;
+				lines = ponder_lines;
+			}
+			return ponder_found;
+		}
+
+		// ponder miss
+		stopPondering();
+	}
+
+	timed = (clock_remaining > 0);
+	if(timed)
+		timer.start(clock_remaining, clock_increment, clock_moves_to_go);
+
+	return search(board, multipv, move, lines);
+}
+
+void AIPlayer::setSeed(unsigned int seed)
+{
+	this->seed = seed;
+}
+
+void AIPlayer::setMultiPV(int count)
+{
+	multipv = max(1, count);
+}
+
+void AIPlayer::setNodeLimit(uint64_t nodes)
+{
+	node_limit = nodes;
+}
+
+void AIPlayer::setClock(int remaining, int increment, int moves_to_go)
+{
+	clock_remaining = remaining;
+	clock_increment = increment;
+	clock_moves_to_go = moves_to_go;
+}
+
+uint64_t AIPlayer::getNodes(void) const
+{
+	return nodes;
+}
+
+bool AIPlayer::isAborted(void) const
+{
+	// the node limit applies once an iteration finished, so there is a move,
+	// the clock always
+	return stop || time_up || (node_limit != 0 && nodes >= node_limit && !last_pv.empty());
+}
+
+void AIPlayer::startPondering(const ChessBoard & board)
+{
+	list<Move> regulars, nulls;
+	list<Move>::iterator it;
+	int opponent = TOGGLE_COLOR(this->color);
+	TTEntry entry;
+
+	stopPondering();
+	abortSearch();
+
+	// the last search left the expected reply in the table
+	if(!transpositions.probe(board.getKey(opponent), entry) || entry.move == 0)
+		return;
+
+	ponder_board = board;
+	ponder_board.getMoves(opponent, regulars, regulars, nulls);
+
+	for(it = regulars.begin(); it != regulars.end(); ++it)
+		if((*it).pack() == entry.move)
+			break;
+
+	if(it == regulars.end())
+		return;
+
+	// play the reply the way the game loop does
+	for(list<Move>::iterator n = nulls.begin(); n != nulls.end(); ++n)
+		ponder_board.move(*n);
+
+	ponder_board.move(*it);
+
+	if(ponder_board.isVulnerable((opponent ? ponder_board.black_king_pos : ponder_board.white_king_pos), opponent))
+		return;
+
+	// the opponent's clock is running, in a game with a clock think until
+	// a ponder hit starts ours, otherwise as deep as without one
+	ponder_key = ponder_board.getKey(this->color);
+	ponder_timed = (clock_remaining > 0);
+	timed = false;
+	pondering = true;
+	ponder_thread = thread(&AIPlayer::ponder, this);
+}
+
+void AIPlayer::stopPondering(void)
+{
+	if(!pondering)
+		return;
+
+	stop = true;
+	ponder_thread.join();
+	stop = false;
+	pondering = false;
+}
+
+void AIPlayer::ponder(void)
+{
+	ponder_found = search(ponder_board, multipv, ponder_move, ponder_lines);
+}
+
+void AIPlayer::startSearch(const ChessBoard & board, SearchCallback callback)
+{
+	stopPondering();
+	abortSearch();
+
+	timed = (clock_remaining > 0);
+	if(timed)
+		timer.start(clock_remaining, clock_increment, clock_moves_to_go);
+
+	search_board = board;
+	progress = callback;
+	searching = true;
+	search_thread = thread(&AIPlayer::runSearch, this);
+}
+
+bool AIPlayer::isSearching(void) const
+{
+	return searching;
+}
+
+void AIPlayer::stopSearch(void)
+{
+	if(searching)
+		stop = true;
+}
+
+bool AIPlayer::waitSearch(Move & move, AnalysisLine & line)
+{
+	if(!search_thread.joinable())
+		return false;
+
+	search_thread.join();
+	stop = false;
+	progress = SearchCallback();
+
+	if(search_found) {
+		move = search_move;
+		line = search_lines[0];
+	}
+	return search_found;
+}
+
+void AIPlayer::abortSearch(void)
+{
+	Move move;
+	AnalysisLine line;
+
+	// the result of a search nobody waited for is of no use any more
+	if(search_thread.joinable()) {
+		stopSearch();
+		waitSearch(move, line);
+	}
+}
+
+void AIPlayer::runSearch(void)
+{
+	search_found = search(search_board, multipv, search_move, search_lines);
+	searching = false;
+}
 
-bool AIPlayer::getMove(ChessBoard & board, Move & move) const
+bool AIPlayer::search(ChessBoard & board, int count, Move & move, vector<AnalysisLine> & lines)
+{
+	vector<Move> excluded, candidates, first_candidates, best_candidates;
+	vector<AnalysisLine> found;
+	AnalysisLine line;
+	SearchProgress report;
+	int depth, best = 0, finished = 0, i;
+	int max_depth = (timed || (pondering && ponder_timed)) ? MAX_PLY / 2 : this->search_depth;
+
+	lines.clear();
+	last_pv.clear();
+	nodes = 0;
+	time_up = false;
+	PERF_RESET();
+
+	// iterative deepening, each iteration follows the line of the last one
+	for(depth = 1; depth <= max_depth; depth++)
+	{
+		// every further line is a root search without the first moves of
+		// the lines before it, the transposition table makes it cheap
+		found.clear();
+		excluded.clear();
+
+		for(i = 0; i < count; i++)
+		{
+			follow_pv = (i == 0);
+			{
+				PERF_SCOPE(PerfSearch);
+				line.score = searchRoot(board, depth, excluded, candidates);
+			}
+
+			if(isAborted() || candidates.empty())
+				break;
+
+			if(i == 0)
+				first_candidates = candidates;
+
+			line.pv.assign(pv_table[0], pv_table[0] + pv_length[0]);
+			found.push_back(line);
+			excluded.push_back(candidates[0]);
+		}
+
+		// aborted, the last finished iteration counts or what the first one
+		// found until then
+		if(isAborted()) {
+			if(finished == 0 && found.empty() && !candidates.empty()) {
+				first_candidates = candidates;
+				line.pv.assign(pv_table[0], pv_table[0] + pv_length[0]);
+				found.push_back(line);
+			}
+			if(finished == 0 && !found.empty()) {
+				lines = found;
+				best = lines[0].score;
+				best_candidates = first_candidates;
+				last_pv = lines[0].pv;
+			}
+			break;
+		}
+
+		// loosing the game?
+		if(found.empty())
+			return false;
+
+		lines = found;
+		best = lines[0].score;
+		best_candidates = first_candidates;
+		finished = depth;
+		last_pv = lines[0].pv;
+
+		if(progress) {
+			report.depth = depth;
+			report.score = best;
+			report.nodes = nodes;
+			report.pv = last_pv;
+			progress(report);
+		}
+
+		// a forced mate needs no deeper search
+		if(best > WIN_VALUE - MAX_PLY)
+			break;
+
+		// no time for another iteration
+		if(timed && timer.iterationDone(last_pv[0].pack(), best))
+			break;
+	}
+
+	PERF_REPORT();
+
+	if(best_candidates.empty())
+		return false;
+
+	// select random move from candidate moves
+	move = best_candidates[rand_r(&seed) % best_candidates.size()];
+
+	// the score of an unfinished first iteration is no result, it would
+	// replace deeper ones
+	if(finished > 0)
+		transpositions.store(board.getKey(this->color), finished, best,
+			TranspositionTable::Exact, move.pack());
+
+	// the first line belongs to the first candidate, an equal one that was
+	// picked instead takes its place if it has a line of its own
+	if(!(lines[0].pv[0] == move)) {
+		for(i = 1; i < (int)lines.size(); i++)
+			if(lines[i].pv[0] == move)
+				break;
+
+		if(i < (int)lines.size()) {
+			swap(lines[0], lines[i]);
+		}
+		else {
+			lines[0].pv.clear();
+			lines[0].pv.push_back(move);
+		}
+	}
+
+	return true;
+}
+
+void AIPlayer::analyze(ChessBoard & board, int count, vector<AnalysisLine> & lines)
+{
+	Move move;
+
+	stopPondering();
+	abortSearch();
+
+	timed = (clock_remaining > 0);
+	if(timed)
+		timer.start(clock_remaining, clock_increment, clock_moves_to_go);
+
+	if(!search(board, max(1, count), move, lines))
+		lines.clear();
+}
+
+int AIPlayer::searchRoot(ChessBoard & board, int depth, const vector<Move> & excluded,
+	vector<Move> & candidates)
 {
 	list<Move> regulars, nulls;
-	vector<Move> candidates;
+	TTEntry entry;
     bool quiescent = false;
 	int best, tmp;
 
 	// first assume we are loosing
 	best = -KING_VALUE;
+	candidates.clear();
+	pv_length[0] = 0;
 
 	// get all moves
 	board.getMoves(this->color, regulars, regulars, nulls);
 
+	// try the best move of an earlier search first, the line of the last
+	// iteration even before
+	if(transpositions.probe(board.getKey(this->color), entry) && entry.move != 0)
+		moveToFront(regulars, entry.move);
+	if(follow_pv && !last_pv.empty())
+		moveToFront(regulars, last_pv[0].pack());
+
 	// execute maintenance moves
 	for(list<Move>::iterator it = nulls.begin(); it != nulls.end(); ++it)
 		board.move(*it);
@@ -37,6 +478,10 @@ bool AIPlayer::getMove(ChessBoard & board, Move & move) const
 	// loop over all moves
 	for(list<Move>::iterator it = regulars.begin(); it != regulars.end(); ++it)
 	{
+		// lines found before
+		if(find(excluded.begin(), excluded.end(), *it) != excluded.end())
+			continue;
+
 		// execute move
 		board.move(*it);
 
@@ -48,11 +493,29 @@ bool AIPlayer::getMove(ChessBoard & board, Move & move) const
 			}
 
 			// recursion
-			tmp = -evalAlphaBeta(board, TOGGLE_COLOR(this->color), this->search_depth - 1, -WIN_VALUE, -best, quiescent);
+			tmp = -evalAlphaBeta(board, TOGGLE_COLOR(this->color), depth - 1, 1, -WIN_VALUE, -best, quiescent);
+			follow_pv = false;
+
+			// only moves searched to the end count, but there has to be one
+			if(isAborted()) {
+				if(candidates.empty()) {
+					best = 0;
+					candidates.push_back(*it);
+					pv_table[0][0] = *it;
+					pv_length[0] = 1;
+				}
+				board.undoMove(*it);
+				break;
+			}
+
 			if(tmp > best) {
 				best = tmp;
 				candidates.clear();
 				candidates.push_back(*it);
+
+				pv_table[0][0] = *it;
+				memcpy(pv_table[0] + 1, pv_table[1], pv_length[1] * sizeof(Move));
+				pv_length[0] = pv_length[1] + 1;
 			}
 			else if(tmp == best) {
 				candidates.push_back(*it);
@@ -67,27 +530,97 @@ bool AIPlayer::getMove(ChessBoard & board, Move & move) const
 	for(list<Move>::iterator it = nulls.begin(); it != nulls.end(); ++it)
 		board.undoMove(*it);
 
-	// loosing the game?
-	if(best < -WIN_VALUE) {
-		return false;
-	}
-	else {
-		// select random move from candidate moves
-		move = candidates[rand() % candidates.size()];
-		return true;
-	}
+	return best;
 }
 
-int AIPlayer::evalAlphaBeta(ChessBoard & board, int color, int search_depth, int alpha, int beta, bool quiescent) const
+int AIPlayer::evalAlphaBeta(ChessBoard & board, int color, int search_depth, int ply,
+	int alpha, int beta, bool quiescent)
 {
 	list<Move> regulars, nulls;
-	int best, tmp;
+	TTEntry entry;
+	uint64_t key = 0;
+	uint16_t hash_move = 0, best_move = 0, excluded = excluded_moves[ply];
+	int best, tmp, bound, alpha_orig, extension, singular_beta;
+	bool in_check, singular = false, legal = false, follow;
+
+	// no line from here yet
+	pv_length[ply] = 0;
+	excluded_moves[ply] = 0;
+
+	// search aborted, the result is thrown away
+	if(isAborted())
+		return 0;
 
-	if(search_depth <= 0 && !quiescent) {
+	nodes++;
+
+	// look at the clock now and then, a ponder hit may have started it
+	if(timed && (nodes & 1023) == 0 && timer.isTimeUp())
+		time_up = true;
+
+	// repeated positions and the fifty-move rule end in a draw
+	if(board.halfmove_clock >= 100 || board.isRepetition())
+		return 0;
+
+	// checks are searched one ply deeper, so the horizon never hides a mate
+	in_check = board.isVulnerable((color ? board.black_king_pos : board.white_king_pos), color);
+	if(in_check && excluded == 0)
+		search_depth++;
+
+	if((search_depth <= 0 && !quiescent) || ply >= MAX_PLY - 1) {
 		if(color)
-			return -evaluateBoard(board);
+			return -evaluate(board);
 		else
-			return +evaluateBoard(board);
+			return +evaluate(board);
+	}
+
+	// no line from here can do better than mate at the next ply or worse
+	// than being mated right here
+	alpha = max(alpha, -WIN_VALUE + ply);
+	beta = min(beta, WIN_VALUE - ply - 1);
+	if(alpha > beta)
+		return alpha;
+
+	alpha_orig = alpha;
+
+	// results of earlier searches, not for the search without the move
+	// that is tested for being singular
+	if(search_depth > 0 && excluded == 0)
+	{
+		key = board.getKey(color);
+		if(transpositions.probe(key, entry))
+		{
+			entry.score = scoreFromTable(entry.score, ply);
+
+			if(entry.depth >= search_depth) {
+				if(entry.bound == TranspositionTable::Exact)
+					return entry.score;
+				if(entry.bound == TranspositionTable::Lower && entry.score > beta)
+					return entry.score;
+				if(entry.bound == TranspositionTable::Upper && entry.score < alpha)
+					return entry.score;
+			}
+
+			hash_move = entry.move;
+
+			// if no other move comes close to the stored score the hash move
+			// is singular and gets searched one ply deeper
+			if(search_depth >= SINGULAR_DEPTH && hash_move != 0
+				&& entry.bound != TranspositionTable::Upper
+				&& entry.depth >= search_depth - 3
+				&& entry.score > -WIN_VALUE + MAX_PLY && entry.score < WIN_VALUE - MAX_PLY)
+			{
+				singular_beta = entry.score - SINGULAR_MARGIN * search_depth;
+				follow = follow_pv;
+
+				excluded_moves[ply] = hash_move;
+				tmp = evalAlphaBeta(board, color, search_depth / 2, ply,
+					singular_beta - 1, singular_beta, quiescent);
+				singular = (tmp < singular_beta);
+
+				follow_pv = follow;
+				pv_length[ply] = 0;
+			}
+		}
 	}
 
 	// first assume we are loosing
@@ -95,6 +628,18 @@ int AIPlayer::evalAlphaBeta(ChessBoard & board, int color, int search_depth, int
 
 	// get all moves
 	board.getMoves(color, regulars, regulars, nulls);
+
+	// try the best move of an earlier search first
+	if(hash_move != 0)
+		moveToFront(regulars, hash_move);
+
+	// on the line of the last iteration its move goes first
+	if(follow_pv) {
+		if(ply < (int)last_pv.size())
+			moveToFront(regulars, last_pv[ply].pack());
+		else
+			follow_pv = false;
+	}
 	
 	// execute maintenance moves
 	for(list<Move>::iterator it = nulls.begin(); it != nulls.end(); ++it)
@@ -104,23 +649,41 @@ int AIPlayer::evalAlphaBeta(ChessBoard & board, int color, int search_depth, int
 	for(list<Move>::iterator it = regulars.begin();
 		alpha <= beta && it != regulars.end(); ++it)
 	{
+		// skipped by the singular search
+		if(excluded != 0 && (*it).pack() == excluded)
+			continue;
+
 		// execute move
 		board.move(*it);
 
-		// check if own king is vulnerable now
-		if(!board.isVulnerable((color ? board.black_king_pos : board.white_king_pos), color)) {
+		// check if own king is vulnerable now, if the move could expose it
+		if(!board.mayExposeKing(*it, in_check)
+			|| !board.isVulnerable((color ? board.black_king_pos : board.white_king_pos), color)) {
+
+			legal = true;
 
 			if((*it).capture == EMPTY)
 				quiescent = false;
             else
                 quiescent = true;
 
+			extension = (singular && (*it).pack() == hash_move) ? 1 : 0;
+
 			// recursion 'n' pruning
-			tmp = -evalAlphaBeta(board, TOGGLE_COLOR(color), search_depth - 1, -beta, -alpha, quiescent);
+			tmp = -evalAlphaBeta(board, TOGGLE_COLOR(color), search_depth - 1 + extension, ply + 1,
+				-beta, -alpha, quiescent);
+			follow_pv = false;
+
 			if(tmp > best) {
 				best = tmp;
+				best_move = (*it).pack();
 				if(tmp > alpha) {
 					alpha = tmp;
+
+					// new best line, this move and the one of the reply
+					pv_table[ply][0] = *it;
+					memcpy(pv_table[ply] + 1, pv_table[ply + 1], pv_length[ply + 1] * sizeof(Move));
+					pv_length[ply] = pv_length[ply + 1] + 1;
 				}
 			}
 		}
@@ -132,45 +695,54 @@ int AIPlayer::evalAlphaBeta(ChessBoard & board, int color, int search_depth, int
 	// undo maintenance moves
 	for(list<Move>::iterator it = nulls.begin(); it != nulls.end(); ++it)
 		board.undoMove(*it);
+
+	// no move at all, mated the sooner the worse, or stalemate
+	if(!legal && excluded == 0)
+		best = in_check ? -WIN_VALUE + ply : 0;
+
+	// remember the result unless the search was aborted
+	if(search_depth > 0 && excluded == 0 && !isAborted())
+	{
+		if(best <= alpha_orig)
+			bound = TranspositionTable::Upper;
+		else if(best >= beta)
+			bound = TranspositionTable::Lower;
+		else
+			bound = TranspositionTable::Exact;
+
+		transpositions.store(key, search_depth, scoreToTable(best, ply), bound, best_move);
+	}
 	
 	return best;
 }
 
+int AIPlayer::evaluate(const ChessBoard & board)
+{
+	int score;
+
+	// quiescent lines reach the same positions over and over
+	if(!evaluations.probe(board.hash, score)) {
+		score = evaluateBoard(board);
+		evaluations.store(board.hash, score);
+	}
+
+	return score;
+}
+
+const EvalCache & AIPlayer::getEvalCache(void) const
+{
+	return evaluations;
+}
+
 int AIPlayer::evaluateBoard(const ChessBoard & board) const
 {
-	int figure, pos, sum = 0, summand;
+	int pos, sum = 0;
+
+	PERF_SCOPE(PerfEvaluate);
 
 	for(pos = 0; pos < 64; pos++)
-	{
-		figure = board.square[pos];
-		switch(FIGURE(figure))
-		{
-			case PAWN:
-				summand = PAWN_VALUE;
-				break;
-			case ROOK:
-				summand = ROOK_VALUE;
-				break;
-			case KNIGHT:
-				summand = KNIGHT_VALUE;
-				break;
-			case BISHOP:
-				summand = BISHOP_VALUE;
-				break;
-			case QUEEN:
-				summand = QUEEN_VALUE;
-				break;
-			case KING:
-				summand = KING_VALUE;
-				break;
-			default:
-				summand = 0;
-				break;
-		}
-		
-		sum += IS_BLACK(figure) ? -summand : summand;
-	}
-	
+		sum += piece_square.values[board.square[pos] & 0x17][pos];
+
 	return sum;
 }
 
@@ -1,49 +1,325 @@
 #ifndef AI_PLAYER_H_INCLUDED
 #define AI_PLAYER_H_INCLUDED
 
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
 #include "chessplayer.h"
+#include "chessboard.h"
+#include "evalcache.h"
+#include "evalparams.h"
+#include "timemanager.h"
+#include "transposition.h"
 
-// Pieces' values
+// Pieces' values, the others are in evalparams.h
 #define WIN_VALUE  50000	// win the game
-#define PAWN_VALUE    30	// 8x
-#define ROOK_VALUE    90	// 2x
-#define KNIGHT_VALUE  85	// 2x
-#define BISHOP_VALUE  84	// 2x
-#define QUEEN_VALUE  300	// 1x
 #define KING_VALUE 	 ((PAWN_VALUE * 8) + (ROOK_VALUE * 2) \
 						+ (KNIGHT_VALUE * 2) + (BISHOP_VALUE * 2) + QUEEN_VALUE + WIN_VALUE)
 
-class ChessBoard;
+// Transposition table entries (16 bytes each)
+#define TT_ENTRIES (1 << 20)
+
+// Evaluation cache entries (8 bytes each)
+#define EVAL_CACHE_ENTRIES (1 << 16)
+
+// Deepest line followed by the search, including quiescent captures and
+// extensions
+#define MAX_PLY 64
+
+// Hash moves are tested for being singular from this depth on, and they are
+// if all other moves score at least this much per ply below
+#define SINGULAR_DEPTH 4
+#define SINGULAR_MARGIN 10
+
+/*
+* A line of play found by search or analysis, score from the point of view
+* of the side to move.
+*/
+struct AnalysisLine
+{
+	int score;
+	std::vector<Move> pv;
+};
+
+/*
+* State of a search after a finished iteration
+*/
+struct SearchProgress
+{
+	int depth;
+	int score;
+	uint64_t nodes;
+	std::vector<Move> pv;
+};
+
+/*
+* Called by the search thread after every finished iteration
+*/
+typedef std::function<void(const SearchProgress &)> SearchCallback;
 
 class AIPlayer: public ChessPlayer {
 
 	public:
-	
-		AIPlayer(int color, int search_depth);
+
+		/*
+		* With a name the transposition table lives in that shared memory
+		* segment, shared with every other player and process using it.
+		*/
+		AIPlayer(int color, int search_depth, const char * shared_table = NULL);
 
 		~AIPlayer();
 
 		/*
-		* Ask player what to do next
+		* Ask player what to do next. If the opponent played the move we
+		* have been pondering on, the running search is taken over and goes
+		* on with our clock.
+		*/
+		bool getMove(ChessBoard & board, Move & move);
+
+		/*
+		* Same as above, also returns the score and the principal variation,
+		* starting with move.
+		*/
+		bool getMove(ChessBoard & board, Move & move, AnalysisLine & line);
+
+		/*
+		* Same as above with the best lines of the search as set by
+		* setMultiPV, best line first and starting with move.
+		*/
+		bool getMove(ChessBoard & board, Move & move, std::vector<AnalysisLine> & lines);
+
+		/*
+		* Find the best count lines of play, each with its exact score and
+		* principal variation, best line first. The search deepens like for
+		* a move and keeps to the clock and the node limit.
+		*/
+		void analyze(ChessBoard & board, int count, std::vector<AnalysisLine> & lines);
+
+		/*
+		* Number of lines searched for every move, 1 by default. Each
+		* iteration searches the root moves again without the first moves
+		* of the lines found before.
+		*/
+		void setMultiPV(int count);
+
+		/*
+		* Break ties between equal moves with a sequence of choices that
+		* only depends on seed.
+		*/
+		void setSeed(unsigned int seed);
+
+		/*
+		* Stop searching after visiting nodes positions, 0 for no limit. The
+		* move of the last finished iteration is played, the first one always
+		* finishes. A game clock is a hard limit.
 		*/
-		bool getMove(ChessBoard & board, Move & move) const;
+		void setNodeLimit(uint64_t nodes);
 
 		/*
-		* MinMax search for best possible outcome
-		*/ 
-		int evalAlphaBeta(ChessBoard & board, int color, int depth, int alpha, int beta, bool quiescent) const;
+		* Think with a game clock instead of a fixed depth. Times are in
+		* milliseconds, moves_to_go counts the moves until the next time
+		* control, 0 for the rest of the game. A remaining time of 0 goes
+		* back to searching search_depth plies. Set it before every move.
+		*/
+		void setClock(int remaining, int increment, int moves_to_go);
+
+		/*
+		* Positions visited by the last search
+		*/
+		uint64_t getNodes(void) const;
+
+		/*
+		* Search the position after the opponent's expected reply on a
+		* background thread. Board is the position after our own move.
+		*/
+		void startPondering(const ChessBoard & board);
+
+		/*
+		* Abort pondering. What was found stays in the transposition table.
+		*/
+		void stopPondering(void);
+
+		/*
+		* Search our move on a thread of its own and return at once. The
+		* board is copied, callback is called from the search thread after
+		* every finished iteration. A running search or pondering is stopped
+		* first.
+		*/
+		void startSearch(const ChessBoard & board, SearchCallback callback = SearchCallback());
+
+		/*
+		* True while the search started by startSearch runs
+		*/
+		bool isSearching(void) const;
+
+		/*
+		* Ask the running search to stop without waiting for it. Its result
+		* is the last finished iteration, like when it runs out of time.
+		*/
+		void stopSearch(void);
+
+		/*
+		* Wait for the search started by startSearch to end and get its
+		* result, like getMove. Returns false if there is no move or no
+		* search was started.
+		*/
+		bool waitSearch(Move & move, AnalysisLine & line);
+
+		/*
+		* MinMax search for best possible outcome. Ply is the distance to the
+		* root, the best line found is left in the PV table at that ply. Being
+		* mated scores -WIN_VALUE plus the ply of the mate.
+		*/
+		int evalAlphaBeta(ChessBoard & board, int color, int depth, int ply,
+			int alpha, int beta, bool quiescent);
 
 		/*
 		* For now, this checks only material
 		*/
 		int evaluateBoard(const ChessBoard & board) const;
-	
+
+		/*
+		* Cache of evaluateBoard results, its hit rate tells if it is big
+		* enough
+		*/
+		const EvalCache & getEvalCache(void) const;
+
 	protected:
 
+		/*
+		* Iterative deepening from the root for the best count lines, used
+		* by getMove, analyze and the ponder thread
+		*/
+		bool search(ChessBoard & board, int count, Move & move,
+			std::vector<AnalysisLine> & lines);
+
+		/*
+		* Loop over all root moves not in excluded. Returns the best score
+		* and all moves reaching it, the line of the first one is left in
+		* the PV table.
+		*/
+		int searchRoot(ChessBoard & board, int depth, const std::vector<Move> & excluded,
+			std::vector<Move> & candidates);
+
+		/*
+		* evaluateBoard through the cache
+		*/
+		int evaluate(const ChessBoard & board);
+
+		/*
+		* True if the search was stopped or ran out of nodes or time
+		*/
+		bool isAborted(void) const;
+
+		/*
+		* Body of the ponder thread
+		*/
+		void ponder(void);
+
+		/*
+		* Stop the search of startSearch and wait for it, dropping its
+		* result. Nothing happens if there is none.
+		*/
+		void abortSearch(void);
+
+		/*
+		* Body of the thread of startSearch
+		*/
+		void runSearch(void);
+
 		/*
 		* how deep to min-max
 		*/
 		int search_depth;
+
+		/*
+		* lines searched for every move
+		*/
+		int multipv;
+
+		/*
+		* state of the random generator breaking ties
+		*/
+		unsigned int seed;
+
+		/*
+		* positions visited by the running search and the limit for them
+		*/
+		uint64_t nodes;
+		uint64_t node_limit;
+
+		/*
+		* game clock, the search of the current move is timed if remaining
+		* is not 0. A ponder hit starts the timer while the ponder thread
+		* searches, so it sees timed change.
+		*/
+		int clock_remaining;
+		int clock_increment;
+		int clock_moves_to_go;
+		TimeManager timer;
+		std::atomic<bool> timed;
+		std::atomic<bool> time_up;
+
+		/*
+		* results of earlier searches
+		*/
+		TranspositionTable transpositions;
+
+		/*
+		* static evaluations of positions seen before
+		*/
+		EvalCache evaluations;
+
+		/*
+		* triangular table of best lines, row ply holds the line from that
+		* ply on
+		*/
+		Move pv_table[MAX_PLY][MAX_PLY];
+		int pv_length[MAX_PLY];
+
+		/*
+		* line of the previous iteration, its moves are tried first as long
+		* as the search follows it
+		*/
+		std::vector<Move> last_pv;
+		bool follow_pv;
+
+		/*
+		* move left out per ply while testing if the hash move is singular,
+		* 0 for none
+		*/
+		uint16_t excluded_moves[MAX_PLY];
+
+		/*
+		* set to abort a running search
+		*/
+		std::atomic<bool> stop;
+
+		/*
+		* pondering state, position after the expected reply and the result
+		* of its search
+		*/
+		std::thread ponder_thread;
+		ChessBoard ponder_board;
+		uint64_t ponder_key;
+		bool ponder_timed;
+		Move ponder_move;
+		std::vector<AnalysisLine> ponder_lines;
+		bool ponder_found;
+		bool pondering;
+
+		/*
+		* state of the search started by startSearch, progress is only set
+		* while it runs
+		*/
+		std::thread search_thread;
+		ChessBoard search_board;
+		Move search_move;
+		std::vector<AnalysisLine> search_lines;
+		SearchCallback progress;
+		std::atomic<bool> searching;
+		bool search_found;
 };
 
 #endif
@@ -0,0 +1,68 @@
+#include <chrono>
+#include <cstdio>
+#include <list>
+#include "aiplayer.h"
+#include "bench.h"
+#include "chessboard.h"
+
+using namespace std;
+
+// Openings, middle games and endings, with castling, en passant and
+// promotions
+static const char * positions[] = {
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+	"rnbqkb1r/pp1p1ppp/4pn2/2pP4/2P5/8/PP2PPPP/RNBQKBNR w KQkq c6 0 4",
+	"r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+	"8/5pk1/6p1/8/3K4/8/5PPP/8 b - - 0 40",
+	"n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1",
+	"6k1/5ppp/8/8/8/8/5PPP/R5K1 w - - 0 1"
+};
+
+// Same choices between equal moves in every run
+#define BENCH_SEED 1
+
+uint64_t bench(int depth, uint64_t node_limit)
+{
+	int i, color, count = sizeof(positions) / sizeof(positions[0]);
+	uint64_t total = 0, probes = 0, hits = 0;
+	double seconds;
+	AnalysisLine line;
+	Move move;
+	char buf[6];
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	for(i = 0; i < count; i++)
+	{
+		ChessBoard board;
+
+		board.initFEN(positions[i], color);
+
+		// a fresh player for every position, nothing carries over
+		AIPlayer player(color, depth);
+		player.setSeed(BENCH_SEED);
+		player.setNodeLimit(node_limit);
+
+		if(player.getMove(board, move, line))
+			move.toString(buf);
+		else
+			sprintf(buf, "none");
+
+		printf("Position %d/%d: %-5s %10llu nodes\n", i + 1, count, buf,
+			(unsigned long long)player.getNodes());
+		total += player.getNodes();
+		probes += player.getEvalCache().getProbes();
+		hits += player.getEvalCache().getHits();
+	}
+
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	printf("\nDepth %d, %.2fs\n", depth, seconds);
+	printf("Nodes searched: %llu\n", (unsigned long long)total);
+	printf("Nodes/second  : %.0f\n", total / seconds);
+	printf("Eval cache    : %.1f%% hits\n", probes ? 100.0 * hits / probes : 0.0);
+
+	return total;
+}
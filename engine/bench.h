@@ -0,0 +1,13 @@
+#ifndef BENCH_H_INCLUDED
+#define BENCH_H_INCLUDED
+
+#include <stdint.h>
+
+/*
+* Searches a fixed set of positions with a fixed seed and prints the nodes
+* visited for each, their total as a signature of the search and the
+* speed. Returns the total, which only changes if the search does.
+*/
+uint64_t bench(int depth, uint64_t node_limit);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef BOOK_H_INCLUDED
+#define BOOK_H_INCLUDED
+
+#include <stdint.h>
+#include <list>
+#include <utility>
+#include <vector>
+#include "chessboard.h"
+#include "mappedfile.h"
+
+/*
+* One move of an opening book in the layout of Polyglot books: 16 bytes,
+* all fields big-endian, the file sorted by key. The moves of a position
+* follow each other, their weights relative to each other. Books written
+* by other Polyglot tools are read as well.
+*/
+struct BookEntry
+{
+	uint64_t key;
+	uint16_t move;
+	uint16_t weight;
+	uint32_t learn;		// zero
+};
+
+/*
+* Polyglot key of a position: Random64 keys of the pieces, the castling
+* rights, the en passant file if a capture there is possible and white to
+* move. The start position is 0x463B96181691FC9C.
+*/
+uint64_t bookKey(const ChessBoard & board, int color);
+
+/*
+* Move in the coding of Polyglot: destination file and rank in bits 0-5,
+* origin in bits 6-11, promotion piece in bits 12-14 (knight 1 to queen 4)
+* and castling written as the king taking its rook.
+*/
+uint16_t encodeBookMove(const Move & move);
+
+/*
+* The entry as written to the file
+*/
+BookEntry makeBookEntry(uint64_t key, uint16_t move, uint16_t weight);
+
+/*
+* An opening book file mapped into memory.
+*/
+class OpeningBook: public RecordFile<BookEntry>
+{
+	public:
+
+		/*
+		* Legal moves the book has for color in this position with their
+		* weights, most weight first. Returns false if there are none.
+		*/
+		bool getMoves(ChessBoard & board, int color,
+			std::vector< std::pair<Move, int> > & moves) const;
+};
+
+#endif
@@ -3,9 +3,166 @@
 #include <list>
 #include "chessboard.h"
 #include "chessplayer.h"
+#include "perfcounters.h"
 
 using namespace std;
 
+static_assert(sizeof(Move) == 4, "Move has to fit into 32 bits");
+static_assert(sizeof(PackedBoard) == 32, "PackedBoard has to fit into 32 bytes");
+
+// Random keys per square and figure. The index of a figure is its type and
+// color plus bit 3 for states that matter to the rules: unmoved kings and
+// rooks (castling rights) and en passant candidates. The side to move has a
+// key of its own.
+struct ZobristKeys
+{
+	uint64_t squares[64][32];
+	uint64_t black;
+};
+
+/*
+* Squares a knight or king reaches from one square, in the order the move
+* generators always produced them.
+*/
+struct LeaperTargets
+{
+	int count;
+	char squares[8];
+};
+
+/*
+* Everything the move generators look up instead of computing it. line
+* holds, for two squares on a common rank, file or diagonal, all squares
+* of that line, and is 0 for squares that are not aligned.
+*/
+struct AttackTables
+{
+	LeaperTargets knight[64];
+	LeaperTargets king[64];
+	uint64_t line[64][64];
+};
+
+static constexpr uint64_t xorshift(uint64_t & x)
+{
+	// xorshift64*
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+static constexpr ZobristKeys makeZobristKeys(void)
+{
+	ZobristKeys keys = {};
+	uint64_t x = 0x9E3779B97F4A7C15ULL;
+	int pos = 0, i = 0;
+
+	for(pos = 0; pos < 64; pos++)
+	{
+		// empty squares do not contribute
+		keys.squares[pos][0] = 0;
+
+		for(i = 1; i < 32; i++)
+			keys.squares[pos][i] = xorshift(x);
+	}
+
+	keys.black = xorshift(x);
+
+	return keys;
+}
+
+static constexpr void addLeaperTargets(LeaperTargets & targets, int pos,
+	const int steps[8][2])
+{
+	int row = 0, col = 0, i = 0;
+
+	targets.count = 0;
+
+	for(i = 0; i < 8; i++)
+	{
+		row = pos / 8 + steps[i][0];
+		col = pos % 8 + steps[i][1];
+
+		if(row >= 0 && row < 8 && col >= 0 && col < 8)
+			targets.squares[targets.count++] = row * 8 + col;
+	}
+}
+
+static constexpr AttackTables makeAttackTables(void)
+{
+	// rows and columns of the steps
+	const int knight_steps[8][2] = {
+		{ 2, 1 }, { 2, -1 }, { -2, 1 }, { -2, -1 },
+		{ 1, 2 }, { -1, 2 }, { 1, -2 }, { -1, -2 }
+	};
+	const int king_steps[8][2] = {
+		{ 1, -1 }, { 0, -1 }, { -1, -1 }, { 1, 1 },
+		{ 0, 1 }, { -1, 1 }, { 1, 0 }, { -1, 0 }
+	};
+	// one direction per line, the other is walked backwards
+	const int directions[4][2] = {
+		{ 1, 0 }, { 0, 1 }, { 1, 1 }, { 1, -1 }
+	};
+
+	AttackTables tables = {};
+	uint64_t mask = 0;
+	int pos = 0, d = 0, sign = 0, row = 0, col = 0;
+
+	for(pos = 0; pos < 64; pos++)
+	{
+		addLeaperTargets(tables.knight[pos], pos, knight_steps);
+		addLeaperTargets(tables.king[pos], pos, king_steps);
+
+		for(d = 0; d < 4; d++)
+		{
+			mask = 1ULL << pos;
+
+			for(sign = -1; sign <= 1; sign += 2)
+			{
+				row = pos / 8 + sign * directions[d][0];
+				col = pos % 8 + sign * directions[d][1];
+
+				for(; row >= 0 && row < 8 && col >= 0 && col < 8;
+					row += sign * directions[d][0], col += sign * directions[d][1])
+					mask |= 1ULL << (row * 8 + col);
+			}
+
+			for(row = 0; row < 64; row++)
+				if(row != pos && (mask & (1ULL << row)))
+					tables.line[pos][row] = mask;
+		}
+	}
+
+	return tables;
+}
+
+// generated by the compiler, nothing to initialize at startup
+static constexpr ZobristKeys zobrist = makeZobristKeys();
+static constexpr AttackTables tables = makeAttackTables();
+
+/*
+* Square as seen from the given side: black's pieces start on the first
+* rank too.
+*/
+template<int Color>
+static constexpr int relative(int pos)
+{
+	return (Color == BLACK) ? pos ^ 56 : pos;
+}
+
+static inline uint64_t zobristKey(int pos, int figure)
+{
+	int index = figure & 0x17;
+
+	if(IS_PASSANT(figure))
+		index |= 0x08;
+	else if(!IS_MOVED(figure) && (FIGURE(figure) == KING || FIGURE(figure) == ROOK))
+		index |= 0x08;
+
+	return zobrist.squares[pos][index];
+}
+
 void Move::print(void) const {
 
 	const char * field_name[] = {
@@ -45,27 +202,47 @@ void Move::print(void) const {
 			break;
 	}
 	
-	printf("from %s to %s:\n", field_name[(int)from], field_name[(int)to]);
+	printf("from %s to %s", field_name[(int)from], field_name[(int)to]);
+
+	switch(promotion) {
+		case QUEEN:
+			printf(" promoting to queen");
+			break;
+		case ROOK:
+			printf(" promoting to rook");
+			break;
+		case KNIGHT:
+			printf(" promoting to knight");
+			break;
+		case BISHOP:
+			printf(" promoting to bishop");
+			break;
+	}
+
+	printf(":\n");
 }
 
-bool Move::operator==(const Move & b) const
+void Move::toString(char * buf) const
 {
-	if(from != b.from)
-		return false;
-	if(to != b.to)
-		return false;
-	if(capture != b.capture)
-		return false;
-	if(figure != b.figure)
-		return false;
-		
-	return true;
+	const char promotion_name[] = { ' ', ' ', 'r', 'n', 'b', 'q' };
+
+	buf[0] = 'a' + from % 8;
+	buf[1] = '1' + from / 8;
+	buf[2] = 'a' + to % 8;
+	buf[3] = '1' + to / 8;
+	buf[4] = (promotion != EMPTY) ? promotion_name[promotion] : '\0';
+	buf[5] = '\0';
 }
 
-
 ChessBoard::ChessBoard()
 {
 	memset((void*)square, EMPTY, sizeof(square));
+	halfmove_clock = 0;
+	history.reserve(1024);
+#ifdef COPY_MAKE
+	saved_squares.reserve(1024);
+#endif
+	resetHistory();
 }
 
 void ChessBoard::print(void) const
@@ -155,37 +332,431 @@ void ChessBoard::initDefaultSetup(void)
 	// register kings
 	black_king_pos = E8;
 	white_king_pos = E1;
+
+	halfmove_clock = 0;
+	resetHistory();
+}
+
+bool ChessBoard::initFEN(const char * fen, int & color)
+{
+	int row = 7, col = 0, figure, pos;
+	bool white_king = false, black_king = false;
+
+	// clear board
+	memset((void*)square, EMPTY, sizeof(square));
+
+	// 1. Piece placement, starting at A8
+	for(; *fen && *fen != ' '; fen++)
+	{
+		if(*fen == '/') {
+			if(col != 8 || row == 0)
+				return false;
+			row--;
+			col = 0;
+			continue;
+		}
+
+		if(*fen >= '1' && *fen <= '8') {
+			col += *fen - '0';
+			if(col > 8)
+				return false;
+			continue;
+		}
+
+		switch(*fen | 0x20)
+		{
+			case 'p': figure = PAWN;   break;
+			case 'r': figure = ROOK;   break;
+			case 'n': figure = KNIGHT; break;
+			case 'b': figure = BISHOP; break;
+			case 'q': figure = QUEEN;  break;
+			case 'k': figure = KING;   break;
+			default:
+				return false;
+		}
+
+		if(col > 7)
+			return false;
+
+		pos = row * 8 + col++;
+
+		// lower case letters denote black pieces
+		if(*fen & 0x20)
+			figure = SET_BLACK(figure);
+
+		// pawns off their initial rank have moved, kings and rooks are
+		// marked unmoved below according to the castling rights
+		if(FIGURE(figure) == PAWN) {
+			if(row != (IS_BLACK(figure) ? 6 : 1))
+				figure = SET_MOVED(figure);
+		}
+		else if(FIGURE(figure) == KING || FIGURE(figure) == ROOK) {
+			figure = SET_MOVED(figure);
+		}
+
+		if(FIGURE(figure) == KING) {
+			if(IS_BLACK(figure)) {
+				black_king_pos = pos;
+				black_king = true;
+			}
+			else {
+				white_king_pos = pos;
+				white_king = true;
+			}
+		}
+
+		square[pos] = figure;
+	}
+
+	if(row != 0 || col != 8 || !white_king || !black_king)
+		return false;
+
+	// 2. Side to move
+	while(*fen == ' ')
+		fen++;
+	if(*fen == 'w')
+		color = WHITE;
+	else if(*fen == 'b')
+		color = BLACK;
+	else
+		return false;
+	fen++;
+
+	// 3. Castling rights clear the moved flag of king and rook
+	while(*fen == ' ')
+		fen++;
+	for(; *fen && *fen != ' '; fen++)
+	{
+		switch(*fen)
+		{
+			case 'K':
+				if((square[E1] & 0x1F) == KING && (square[H1] & 0x1F) == ROOK) {
+					square[E1] = KING;
+					square[H1] = ROOK;
+				}
+				break;
+			case 'Q':
+				if((square[E1] & 0x1F) == KING && (square[A1] & 0x1F) == ROOK) {
+					square[E1] = KING;
+					square[A1] = ROOK;
+				}
+				break;
+			case 'k':
+				if((square[E8] & 0x1F) == SET_BLACK(KING) && (square[H8] & 0x1F) == SET_BLACK(ROOK)) {
+					square[E8] = SET_BLACK(KING);
+					square[H8] = SET_BLACK(ROOK);
+				}
+				break;
+			case 'q':
+				if((square[E8] & 0x1F) == SET_BLACK(KING) && (square[A8] & 0x1F) == SET_BLACK(ROOK)) {
+					square[E8] = SET_BLACK(KING);
+					square[A8] = SET_BLACK(ROOK);
+				}
+				break;
+			case '-':
+				break;
+			default:
+				return false;
+		}
+	}
+
+	// 4. En passant target square marks the pawn that just moved two steps
+	while(*fen == ' ')
+		fen++;
+	if(*fen >= 'a' && *fen <= 'h' && (fen[1] == '3' || fen[1] == '6')) {
+		pos = (fen[1] == '3') ? (fen[0] - 'a') + 24 : (fen[0] - 'a') + 32;
+		if(FIGURE(square[pos]) == PAWN)
+			square[pos] = SET_PASSANT(square[pos]);
+	}
+
+	// 5. Halfmove clock, the move number is ignored
+	while(*fen && *fen != ' ')
+		fen++;
+	halfmove_clock = 0;
+	for(; *fen == ' '; fen++)
+		;
+	for(; *fen >= '0' && *fen <= '9'; fen++)
+		halfmove_clock = halfmove_clock * 10 + (*fen - '0');
+
+	resetHistory();
+	return true;
+}
+
+bool ChessBoard::initPacked(const PackedBoard & packed, int & color)
+{
+	bool white_king = false, black_king = false;
+	int pos, code, figure, i = 0;
+
+	// clear board
+	memset((void*)square, EMPTY, sizeof(square));
+
+	// 1. Pieces of the occupied squares, kings and rooks unmoved only with
+	// castling rights and pawns off their initial rank moved, like initFEN
+	for(pos = 0; pos < 64; pos++)
+	{
+		if(!(packed.occupancy & (1ULL << pos)))
+			continue;
+
+		if(i == 32)
+			return false;
+
+		code = (packed.pieces[i / 2] >> (4 * (i % 2))) & 0x0F;
+		i++;
+
+		figure = code & 0x07;
+		if(figure < PAWN || figure > KING)
+			return false;
+
+		if(code & 0x08)
+			figure = SET_BLACK(figure);
+
+		if(FIGURE(figure) == PAWN) {
+			if(pos / 8 != (IS_BLACK(figure) ? 6 : 1))
+				figure = SET_MOVED(figure);
+		}
+		else if(FIGURE(figure) == KING || FIGURE(figure) == ROOK) {
+			figure = SET_MOVED(figure);
+		}
+
+		if(FIGURE(figure) == KING) {
+			if(IS_BLACK(figure)) {
+				black_king_pos = pos;
+				black_king = true;
+			}
+			else {
+				white_king_pos = pos;
+				white_king = true;
+			}
+		}
+
+		square[pos] = figure;
+	}
+
+	if(!white_king || !black_king)
+		return false;
+
+	// 2. Side to move
+	color = (packed.flags & PACKED_BLACK) ? BLACK : WHITE;
+
+	// 3. Castling rights, pack never sets them without king and rook on
+	// their initial squares, so such flags come from a damaged record
+	if(packed.flags & PACKED_WHITE_SHORT) {
+		if((square[E1] & 0x1F) != KING || (square[H1] & 0x1F) != ROOK)
+			return false;
+		square[E1] = KING;
+		square[H1] = ROOK;
+	}
+	if(packed.flags & PACKED_WHITE_LONG) {
+		if((square[E1] & 0x1F) != KING || (square[A1] & 0x1F) != ROOK)
+			return false;
+		square[E1] = KING;
+		square[A1] = ROOK;
+	}
+	if(packed.flags & PACKED_BLACK_SHORT) {
+		if((square[E8] & 0x1F) != SET_BLACK(KING) || (square[H8] & 0x1F) != SET_BLACK(ROOK))
+			return false;
+		square[E8] = SET_BLACK(KING);
+		square[H8] = SET_BLACK(ROOK);
+	}
+	if(packed.flags & PACKED_BLACK_LONG) {
+		if((square[E8] & 0x1F) != SET_BLACK(KING) || (square[A8] & 0x1F) != SET_BLACK(ROOK))
+			return false;
+		square[E8] = SET_BLACK(KING);
+		square[A8] = SET_BLACK(ROOK);
+	}
+
+	// 4. En passant target square marks the pawn that just moved two steps
+	if(packed.passant >= A3 && packed.passant <= H3 && FIGURE(square[packed.passant + 8]) == PAWN)
+		square[packed.passant + 8] = SET_PASSANT(square[packed.passant + 8]);
+	else if(packed.passant >= A6 && packed.passant <= H6 && FIGURE(square[packed.passant - 8]) == PAWN)
+		square[packed.passant - 8] = SET_PASSANT(square[packed.passant - 8]);
+
+	// 5. Halfmove clock
+	halfmove_clock = packed.halfmove_clock;
+
+	resetHistory();
+	return true;
+}
+
+void ChessBoard::pack(int color, PackedBoard & packed) const
+{
+	int pos, figure, code, i = 0;
+
+	memset(&packed, 0, sizeof(packed));
+
+	for(pos = 0; pos < 64; pos++)
+	{
+		if((figure = square[pos]) == EMPTY)
+			continue;
+
+		code = FIGURE(figure) | (IS_BLACK(figure) ? 0x08 : 0x00);
+		packed.occupancy |= 1ULL << pos;
+		packed.pieces[i / 2] |= code << (4 * (i % 2));
+		i++;
+
+		// only a pawn of the side that just moved can be taken en passant,
+		// the flags of the other side are stale until its next move
+		if(FIGURE(figure) == PAWN && IS_PASSANT(figure) && IS_BLACK(figure) != color)
+			packed.passant = IS_BLACK(figure) ? pos + 8 : pos - 8;
+	}
+
+	if(color)
+		packed.flags |= PACKED_BLACK;
+
+	// unmoved kings and rooks on their initial squares
+	if((square[E1] & 0x3F) == KING) {
+		if((square[H1] & 0x3F) == ROOK)
+			packed.flags |= PACKED_WHITE_SHORT;
+		if((square[A1] & 0x3F) == ROOK)
+			packed.flags |= PACKED_WHITE_LONG;
+	}
+	if((square[E8] & 0x3F) == SET_BLACK(KING)) {
+		if((square[H8] & 0x3F) == SET_BLACK(ROOK))
+			packed.flags |= PACKED_BLACK_SHORT;
+		if((square[A8] & 0x3F) == SET_BLACK(ROOK))
+			packed.flags |= PACKED_BLACK_LONG;
+	}
+
+	packed.halfmove_clock = (halfmove_clock < 255) ? halfmove_clock : 255;
+}
+
+void ChessBoard::toFEN(int color, char * fen) const
+{
+	const char letters[] = " PRNBQK";
+	int row, col, figure, empty, passant = -1;
+	char * p = fen;
+
+	// 1. Piece placement, starting at A8
+	for(row = 7; row >= 0; row--)
+	{
+		for(col = 0, empty = 0; col < 8; col++)
+		{
+			if((figure = square[row * 8 + col]) == EMPTY) {
+				empty++;
+				continue;
+			}
+
+			if(empty)
+				*p++ = '0' + empty;
+			empty = 0;
+
+			*p++ = IS_BLACK(figure) ? (letters[FIGURE(figure)] | 0x20) : letters[FIGURE(figure)];
+
+			// like in pack, only the side that just moved has a passant pawn
+			if(FIGURE(figure) == PAWN && IS_PASSANT(figure) && IS_BLACK(figure) != color)
+				passant = IS_BLACK(figure) ? row * 8 + col + 8 : row * 8 + col - 8;
+		}
+
+		if(empty)
+			*p++ = '0' + empty;
+		if(row)
+			*p++ = '/';
+	}
+
+	// 2. Side to move
+	*p++ = ' ';
+	*p++ = color ? 'b' : 'w';
+	*p++ = ' ';
+
+	// 3. Castling rights of unmoved kings and rooks
+	if((square[E1] & 0x3F) == KING && (square[H1] & 0x3F) == ROOK)
+		*p++ = 'K';
+	if((square[E1] & 0x3F) == KING && (square[A1] & 0x3F) == ROOK)
+		*p++ = 'Q';
+	if((square[E8] & 0x3F) == SET_BLACK(KING) && (square[H8] & 0x3F) == SET_BLACK(ROOK))
+		*p++ = 'k';
+	if((square[E8] & 0x3F) == SET_BLACK(KING) && (square[A8] & 0x3F) == SET_BLACK(ROOK))
+		*p++ = 'q';
+	if(p[-1] == ' ')
+		*p++ = '-';
+
+	// 4. En passant target square, 5. halfmove clock and move number
+	if(passant >= 0)
+		sprintf(p, " %c%c %d 1", 'a' + passant % 8, '1' + passant / 8, halfmove_clock);
+	else
+		sprintf(p, " - %d 1", halfmove_clock);
+}
+
+void ChessBoard::getPawnMoves(int figure, int pos, list<Move> & moves, list<Move> & captures, list<Move> & null_moves) const
+{
+	if(IS_BLACK(figure))
+		getPawnMoves<BLACK>(figure, pos, moves, captures, null_moves);
+	else
+		getPawnMoves<WHITE>(figure, pos, moves, captures, null_moves);
+}
+
+void ChessBoard::getRookMoves(int figure, int pos, list<Move> & moves, list<Move> & captures) const
+{
+	if(IS_BLACK(figure))
+		getRookMoves<BLACK>(figure, pos, moves, captures);
+	else
+		getRookMoves<WHITE>(figure, pos, moves, captures);
+}
+
+void ChessBoard::getKnightMoves(int figure, int pos, list<Move> & moves, list<Move> & captures) const
+{
+	if(IS_BLACK(figure))
+		getKnightMoves<BLACK>(figure, pos, moves, captures);
+	else
+		getKnightMoves<WHITE>(figure, pos, moves, captures);
+}
+
+void ChessBoard::getBishopMoves(int figure, int pos, list<Move> & moves, list<Move> & captures) const
+{
+	if(IS_BLACK(figure))
+		getBishopMoves<BLACK>(figure, pos, moves, captures);
+	else
+		getBishopMoves<WHITE>(figure, pos, moves, captures);
+}
+
+void ChessBoard::getQueenMoves(int figure, int pos, list<Move> & moves, list<Move> & captures) const
+{
+	if(IS_BLACK(figure))
+		getQueenMoves<BLACK>(figure, pos, moves, captures);
+	else
+		getQueenMoves<WHITE>(figure, pos, moves, captures);
+}
+
+void ChessBoard::getKingMoves(int figure, int pos, list<Move> & moves, list<Move> & captures)
+{
+	if(IS_BLACK(figure))
+		getKingMoves<BLACK>(figure, pos, moves, captures);
+	else
+		getKingMoves<WHITE>(figure, pos, moves, captures);
 }
 
-void ChessBoard::getMoves(int color, list<Move> & moves, list<Move> & captures, list<Move> & null_moves)
+template<int Color>
+void ChessBoard::getMoves(list<Move> & moves, list<Move> & captures, list<Move> & null_moves)
 {
 	int pos, figure;
+
+	PERF_SCOPE(PerfGetMoves);
 	
 	for(pos = 0; pos < 64; pos++)
 	{
 		if((figure = this->square[pos]) != EMPTY)
 		{
-			if(IS_BLACK(figure) == color)
+			if(IS_BLACK(figure) == Color)
 			{
 				switch(FIGURE(figure))
 				{
 					case PAWN:
-						getPawnMoves(figure, pos, moves, captures, null_moves);
+						getPawnMoves<Color>(figure, pos, moves, captures, null_moves);
 						break;
 					case ROOK:
-						getRookMoves(figure, pos, moves, captures);
+						getRookMoves<Color>(figure, pos, moves, captures);
 						break;
 					case KNIGHT:
-						getKnightMoves(figure, pos, moves, captures);
+						getKnightMoves<Color>(figure, pos, moves, captures);
 						break;
 					case BISHOP:
-						getBishopMoves(figure, pos, moves, captures);
+						getBishopMoves<Color>(figure, pos, moves, captures);
 						break;
 					case QUEEN:
-						getQueenMoves(figure, pos, moves, captures);
+						getQueenMoves<Color>(figure, pos, moves, captures);
 						break;
 					case KING:
-						getKingMoves(figure, pos, moves, captures);
+						getKingMoves<Color>(figure, pos, moves, captures);
 						break;
 					default:
 						break;
@@ -195,8 +766,34 @@ void ChessBoard::getMoves(int color, list<Move> & moves, list<Move> & captures,
 	}
 }
 
+/*
+* Adds a pawn move, once for every possible piece if the pawn reaches the
+* last rank.
+*/
+static void addPawnMove(Move & move, list<Move> & moves)
+{
+	if(move.to / 8 == 0 || move.to / 8 == 7)
+	{
+		move.promotion = QUEEN;
+		moves.push_back(move);
+		move.promotion = KNIGHT;
+		moves.push_back(move);
+		move.promotion = ROOK;
+		moves.push_back(move);
+		move.promotion = BISHOP;
+		moves.push_back(move);
+		move.promotion = EMPTY;
+	}
+	else
+	{
+		moves.push_back(move);
+	}
+}
+
+template<int Color>
 void ChessBoard::getPawnMoves(int figure, int pos, list<Move> & moves, list<Move> & captures, list<Move>  & null_moves) const
 {
+	const int forward = (Color == BLACK) ? -8 : 8;
 	Move new_move;
 	int target_pos, target_figure;
 
@@ -208,6 +805,7 @@ void ChessBoard::getPawnMoves(int figure, int pos, list<Move> & moves, list<Move
 		new_move.from = pos;
 		new_move.to = pos;
 		new_move.capture = figure;
+		new_move.promotion = EMPTY;
 		null_moves.push_back(new_move);
 		
 		figure = CLEAR_PASSANT(figure);
@@ -216,21 +814,22 @@ void ChessBoard::getPawnMoves(int figure, int pos, list<Move> & moves, list<Move
 	// Of course, we only have to set this once
 	new_move.figure = figure;
 	new_move.from = pos;
+	new_move.promotion = EMPTY;
 
 	// 1. One step ahead
-	target_pos = IS_BLACK(figure) ? pos - 8 : pos + 8;
+	target_pos = pos + forward;
 	if((target_pos >= 0) && (target_pos < 64))
 	{
 		if((target_figure = this->square[target_pos]) == EMPTY)
 		{
 			new_move.to = target_pos;
 			new_move.capture = target_figure;
-			moves.push_back(new_move);
+			addPawnMove(new_move, moves);
 			
 			// 2. Two steps ahead if unmoved
 			if(!IS_MOVED(figure))
 			{
-				target_pos = IS_BLACK(figure) ? pos - 16 : pos + 16;
+				target_pos = pos + 2 * forward;
 				if((target_pos >= 0) && (target_pos < 64))
 				{
 					if((target_figure = this->square[target_pos]) == EMPTY)
@@ -251,16 +850,16 @@ void ChessBoard::getPawnMoves(int figure, int pos, list<Move> & moves, list<Move
 	// 3. Forward capture (White left; Black right)
 	if(pos % 8 != 0)
 	{
-		target_pos = IS_BLACK(figure) ? pos - 9 : pos + 7;
+		target_pos = pos + forward - 1;
 		if((target_pos >= 0) && (target_pos < 64))
 		{
 			if((target_figure = this->square[target_pos]) != EMPTY)
 			{
-				if(IS_BLACK(target_figure) != IS_BLACK(figure))
+				if(IS_BLACK(target_figure) != Color)
 				{
 					new_move.to = target_pos;
 					new_move.capture = target_figure;
-					captures.push_back(new_move);
+					addPawnMove(new_move, captures);
 				}
 			}
 			else
@@ -269,7 +868,7 @@ void ChessBoard::getPawnMoves(int figure, int pos, list<Move> & moves, list<Move
 				target_figure = this->square[pos - 1];
 				if(IS_PASSANT(target_figure))
 				{
-					if(IS_BLACK(target_figure) != IS_BLACK(figure))
+					if(IS_BLACK(target_figure) != Color)
 					{
 						new_move.to = target_pos;
 						new_move.capture = target_figure;
@@ -283,16 +882,16 @@ void ChessBoard::getPawnMoves(int figure, int pos, list<Move> & moves, list<Move
 	// 4. Forward capture (White right; Black left)
 	if(pos % 8 != 7)
 	{
-		target_pos = IS_BLACK(figure) ? pos - 7 : pos + 9;
+		target_pos = pos + forward + 1;
 		if((target_pos >= 0) && (target_pos < 64))
 		{
 			if((target_figure = this->square[target_pos]) != EMPTY)
 			{
-				if(IS_BLACK(target_figure) != IS_BLACK(figure))
+				if(IS_BLACK(target_figure) != Color)
 				{
 					new_move.to = target_pos;
 					new_move.capture = target_figure;
-					captures.push_back(new_move);
+					addPawnMove(new_move, captures);
 				}
 			}
 			else
@@ -301,7 +900,7 @@ void ChessBoard::getPawnMoves(int figure, int pos, list<Move> & moves, list<Move
 				target_figure = this->square[pos + 1];
 				if(IS_PASSANT(target_figure))
 				{
-					if(IS_BLACK(target_figure) != IS_BLACK(figure))
+					if(IS_BLACK(target_figure) != Color)
 					{
 						new_move.to = target_pos;
 						new_move.capture = target_figure;
@@ -313,6 +912,7 @@ void ChessBoard::getPawnMoves(int figure, int pos, list<Move> & moves, list<Move
 	}	
 }
 
+template<int Color>
 void ChessBoard::getRookMoves(int figure, int pos, list<Move> & moves, list<Move> & captures) const
 {
 	Move new_move;
@@ -321,13 +921,14 @@ void ChessBoard::getRookMoves(int figure, int pos, list<Move> & moves, list<Move
 	// Of course, we only have to set this once
 	new_move.figure = figure;
 	new_move.from = pos;
+	new_move.promotion = EMPTY;
 
 	// 1. Move up
 	for(target_pos = pos + 8; target_pos < 64; target_pos += 8)
 	{
 		if((target_figure = this->square[target_pos]) != EMPTY)
 		{
-			if(IS_BLACK(figure) != IS_BLACK(target_figure))
+			if(IS_BLACK(target_figure) != Color)
 			{
 				new_move.to = target_pos;
 				new_move.capture = target_figure;
@@ -349,7 +950,7 @@ void ChessBoard::getRookMoves(int figure, int pos, list<Move> & moves, list<Move
 	{	
 		if((target_figure = this->square[target_pos]) != EMPTY)
 		{
-			if(IS_BLACK(figure) != IS_BLACK(target_figure))
+			if(IS_BLACK(target_figure) != Color)
 			{
 				new_move.to = target_pos;
 				new_move.capture = target_figure;
@@ -371,7 +972,7 @@ void ChessBoard::getRookMoves(int figure, int pos, list<Move> & moves, list<Move
 	{
 		if((target_figure = this->square[target_pos]) != EMPTY)
 		{
-			if(IS_BLACK(figure) != IS_BLACK(target_figure))
+			if(IS_BLACK(target_figure) != Color)
 			{
 				new_move.to = target_pos;
 				new_move.capture = target_figure;
@@ -393,7 +994,7 @@ void ChessBoard::getRookMoves(int figure, int pos, list<Move> & moves, list<Move
 	{
 		if((target_figure = this->square[target_pos]) != EMPTY)
 		{
-			if(IS_BLACK(figure) != IS_BLACK(target_figure))
+			if(IS_BLACK(target_figure) != Color)
 			{
 				new_move.to = target_pos;
 				new_move.capture = target_figure;
@@ -411,437 +1012,80 @@ void ChessBoard::getRookMoves(int figure, int pos, list<Move> & moves, list<Move
 	}
 }
 
-void ChessBoard::getKnightMoves(int figure, int pos, list<Move> & moves, list<Move> & captures) const
+/*
+* Steps of a knight or king to the given targets, onto empty squares or
+* onto pieces of the opponent.
+*/
+template<int Color>
+void ChessBoard::addLeaperMoves(Move & new_move, const LeaperTargets & targets,
+	list<Move> & moves, list<Move> & captures) const
 {
-	Move new_move;
-	int target_pos, target_figure, row, col;
-
-	// Of course, we only have to set this once
-	new_move.figure = figure;
-	new_move.from = pos;
+	int target_pos, target_figure, i;
 
-	// Determine row and column
-	row = pos / 8;
-	col = pos % 8;
-
-	// 1. Upper positions
-	if(row < 6)
+	for(i = 0; i < targets.count; i++)
 	{
-		// right
-		if(col < 7)
+		target_pos = targets.squares[i];
+
+		if((target_figure = this->square[target_pos]) != EMPTY)
 		{
-			target_pos = pos + 17;
-		
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(figure) != IS_BLACK(target_figure))
-				{
-					new_move.capture = target_figure;
-					new_move.to = target_pos;
-					captures.push_back(new_move);
-				}
-			}
-			else
+			if(IS_BLACK(target_figure) != Color)
 			{
 				new_move.capture = target_figure;
 				new_move.to = target_pos;
-				moves.push_back(new_move);
+				captures.push_back(new_move);
 			}
 		}
-		
-		// left
-		if(col > 0)
-		{
-			target_pos = pos + 15;
-		
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(figure) != IS_BLACK(target_figure))
-				{
-					new_move.capture = target_figure;
-					new_move.to = target_pos;
-					captures.push_back(new_move);
-				}
-			}
-			else
-			{
-				new_move.capture = target_figure;
-				new_move.to = target_pos;
-				moves.push_back(new_move);
-			}		
-		}
-	}
-	
-	// 2. Lower positions
-	if(row > 1)
-	{
-		// right
-		if(col < 7)
-		{
-			target_pos = pos - 15;
-		
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(figure) != IS_BLACK(target_figure))
-				{
-					new_move.capture = target_figure;
-					new_move.to = target_pos;
-					captures.push_back(new_move);
-				}
-			}
-			else
-			{
-				new_move.capture = target_figure;
-				new_move.to = target_pos;
-				moves.push_back(new_move);
-			}
-		}
-		
-		// left
-		if(col > 0)
-		{
-			target_pos = pos - 17;
-		
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(figure) != IS_BLACK(target_figure))
-				{
-					new_move.capture = target_figure;
-					new_move.to = target_pos;
-					captures.push_back(new_move);
-				}
-			}
-			else
-			{
-				new_move.capture = target_figure;
-				new_move.to = target_pos;
-				moves.push_back(new_move);
-			}		
-		}
-	}
-
-	// 3. Right positions
-	if(col < 6)
-	{
-		// up
-		if(row < 7)
-		{
-			target_pos = pos + 10;
-		
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(figure) != IS_BLACK(target_figure))
-				{
-					new_move.capture = target_figure;
-					new_move.to = target_pos;
-					captures.push_back(new_move);
-				}
-			}
-			else
-			{
-				new_move.capture = target_figure;
-				new_move.to = target_pos;
-				moves.push_back(new_move);
-			}
-		}
-		
-		// down
-		if(row > 0)
+		else
 		{
-			target_pos = pos - 6;
-		
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(figure) != IS_BLACK(target_figure))
-				{
-					new_move.capture = target_figure;
-					new_move.to = target_pos;
-					captures.push_back(new_move);
-				}
-			}
-			else
-			{
-				new_move.capture = target_figure;
-				new_move.to = target_pos;
-				moves.push_back(new_move);
-			}		
+			new_move.capture = target_figure;
+			new_move.to = target_pos;
+			moves.push_back(new_move);
 		}
 	}
-
-	// 4. Left positions
-	if(col > 1)
-	{
-		// up
-		if(row < 7)
-		{
-			target_pos = pos + 6;
-		
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(figure) != IS_BLACK(target_figure))
-				{
-					new_move.capture = target_figure;
-					new_move.to = target_pos;
-					captures.push_back(new_move);
-				}
-			}
-			else
-			{
-				new_move.capture = target_figure;
-				new_move.to = target_pos;
-				moves.push_back(new_move);
-			}
-		}
-		
-		// down
-		if(row > 0)
-		{
-			target_pos = pos - 10;
-		
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(figure) != IS_BLACK(target_figure))
-				{
-					new_move.capture = target_figure;
-					new_move.to = target_pos;
-					captures.push_back(new_move);
-				}
-			}
-			else
-			{
-				new_move.capture = target_figure;
-				new_move.to = target_pos;
-				moves.push_back(new_move);
-			}		
-		}
-	}	
 }
 
-void ChessBoard::getBishopMoves(int figure, int pos, list<Move> & moves, list<Move> & captures) const
+template<int Color>
+void ChessBoard::getKnightMoves(int figure, int pos, list<Move> & moves, list<Move> & captures) const
 {
 	Move new_move;
-	int target_pos, target_figure, row, col, i, j;
 
 	// Of course, we only have to set this once
 	new_move.figure = figure;
 	new_move.from = pos;
+	new_move.promotion = EMPTY;
 
-	// Determine row and column
-	row = pos / 8;
-	col = pos % 8;
-
-	// 1. Go north-east
-	for(i = row + 1, j = col + 1; (i < 8) && (j < 8); i++, j++)
-	{
-		target_pos = i * 8 + j;
-		if((target_figure = this->square[target_pos]) != EMPTY)
-		{
-			if(IS_BLACK(figure) != IS_BLACK(target_figure))
-			{
-				new_move.to = target_pos;
-				new_move.capture = target_figure;
-				captures.push_back(new_move);
-			}
-
-			break;
-		}
-		else
-		{
-			new_move.to = target_pos;
-			new_move.capture = target_figure;
-			moves.push_back(new_move);
-		}
-	}
-	
-	// 2. Go south-east
-	for(i = row - 1, j = col + 1; (i >= 0) && (j < 8); i--, j++)
-	{
-		target_pos = i * 8 + j;
-		if((target_figure = this->square[target_pos]) != EMPTY)
-		{
-			if(IS_BLACK(figure) != IS_BLACK(target_figure))
-			{
-				new_move.to = target_pos;
-				new_move.capture = target_figure;
-				captures.push_back(new_move);
-			}
-			
-			break;
-		}
-		else
-		{
-			new_move.to = target_pos;
-			new_move.capture = target_figure;
-			moves.push_back(new_move);
-		}
-	}
-
-	// 3. Go south-west
-	for(i = row - 1, j = col - 1; (i >= 0) && (j >= 0); i--, j--)
-	{
-		target_pos = i * 8 + j;
-		if((target_figure = this->square[target_pos]) != EMPTY)
-		{
-			if(IS_BLACK(figure) != IS_BLACK(target_figure))
-			{
-				new_move.to = target_pos;
-				new_move.capture = target_figure;
-				captures.push_back(new_move);
-			}
-			
-			break;
-		}
-		else
-		{
-			new_move.to = target_pos;
-			new_move.capture = target_figure;
-			moves.push_back(new_move);
-		}
-	}
-
-	// 4. Go north-west
-	for(i = row + 1, j = col - 1; (i < 8) && (j >= 0); i++, j--)
-	{
-		target_pos = i * 8 + j;
-		if((target_figure = this->square[target_pos]) != EMPTY)
-		{
-			if(IS_BLACK(figure) != IS_BLACK(target_figure))
-			{
-				new_move.to = target_pos;
-				new_move.capture = target_figure;
-				captures.push_back(new_move);
-			}
-			
-			break;
-		}
-		else
-		{
-			new_move.to = target_pos;
-			new_move.capture = target_figure;
-			moves.push_back(new_move);
-		}
-	}
+	addLeaperMoves<Color>(new_move, tables.knight[pos], moves, captures);
 }
 
-void ChessBoard::getQueenMoves(int figure, int pos, list<Move> & moves, list<Move> & captures) const
-{
-	// Queen is just the "cartesian product" of Rook and Bishop
-	this->getRookMoves(figure, pos, moves, captures);
-	this->getBishopMoves(figure, pos, moves, captures);
-}
-
-
-void ChessBoard::getKingMoves(int figure, int pos, list<Move> & moves, list<Move> & captures)
+template<int Color>
+void ChessBoard::getBishopMoves(int figure, int pos, list<Move> & moves, list<Move> & captures) const
 {
 	Move new_move;
-	int target_pos, target_figure, row, col;
+	int target_pos, target_figure, row, col, i, j;
 
 	// Of course, we only have to set this once
-	new_move.figure = figure;
-	new_move.from = pos;
-
-	// Determine row and column
-	row = pos / 8;
-	col = pos % 8;
-
-	// 1. Move left
-	if(col > 0)
-	{
-		// 1.1 up
-		if(row < 7)
-		{
-			target_pos = pos + 7;
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(target_figure) != IS_BLACK(figure))
-				{
-					new_move.capture = target_figure;
-					new_move.to = target_pos;
-					captures.push_back(new_move);
-				}
-			}
-			else
-			{
-				new_move.to = target_pos;
-				new_move.capture = target_figure;
-				moves.push_back(new_move);
-			}
-		}
-		
-		// 1.2 middle
-		target_pos = pos - 1;
-		if((target_figure = this->square[target_pos]) != EMPTY)
-		{
-			if(IS_BLACK(target_figure) != IS_BLACK(figure))
-			{
-				new_move.capture = target_figure;
-				new_move.to = target_pos;
-				captures.push_back(new_move);
-			}
-		}
-		else
-		{
-			new_move.to = target_pos;
-			new_move.capture = target_figure;
-			moves.push_back(new_move);
-		}
-		
-		// 1.3 down
-		if(row > 0)
-		{
-			target_pos = pos - 9;
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(target_figure) != IS_BLACK(figure))
-				{
-					new_move.capture = target_figure;
-					new_move.to = target_pos;
-					captures.push_back(new_move);
-				}
-			}
-			else
-			{
-				new_move.to = target_pos;
-				new_move.capture = target_figure;
-				moves.push_back(new_move);
-			}
-		}
-	}
-	
-	// 2. Move right
-	if(col < 7)
-	{
-		// 2.1 up
-		if(row < 7)
-		{
-			target_pos = pos + 9;
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(target_figure) != IS_BLACK(figure))
-				{
-					new_move.capture = target_figure;
-					new_move.to = target_pos;
-					captures.push_back(new_move);
-				}
-			}
-			else
-			{
-				new_move.to = target_pos;
-				new_move.capture = target_figure;
-				moves.push_back(new_move);
-			}
-		}
-		
-		// 2.2 middle
-		target_pos = pos + 1;
+	new_move.figure = figure;
+	new_move.from = pos;
+	new_move.promotion = EMPTY;
+
+	// Determine row and column
+	row = pos / 8;
+	col = pos % 8;
+
+	// 1. Go north-east
+	for(i = row + 1, j = col + 1; (i < 8) && (j < 8); i++, j++)
+	{
+		target_pos = i * 8 + j;
 		if((target_figure = this->square[target_pos]) != EMPTY)
 		{
-			if(IS_BLACK(target_figure) != IS_BLACK(figure))
+			if(IS_BLACK(target_figure) != Color)
 			{
-				new_move.capture = target_figure;
 				new_move.to = target_pos;
+				new_move.capture = target_figure;
 				captures.push_back(new_move);
 			}
+
+			break;
 		}
 		else
 		{
@@ -849,115 +1093,143 @@ void ChessBoard::getKingMoves(int figure, int pos, list<Move> & moves, list<Move
 			new_move.capture = target_figure;
 			moves.push_back(new_move);
 		}
-		
-		// 2.3 down
-		if(row > 0)
+	}
+	
+	// 2. Go south-east
+	for(i = row - 1, j = col + 1; (i >= 0) && (j < 8); i--, j++)
+	{
+		target_pos = i * 8 + j;
+		if((target_figure = this->square[target_pos]) != EMPTY)
 		{
-			target_pos = pos - 7;
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(target_figure) != IS_BLACK(figure))
-				{
-					new_move.capture = target_figure;
-					new_move.to = target_pos;
-					captures.push_back(new_move);
-				}
-			}
-			else
+			if(IS_BLACK(target_figure) != Color)
 			{
 				new_move.to = target_pos;
 				new_move.capture = target_figure;
-				moves.push_back(new_move);
+				captures.push_back(new_move);
 			}
+			
+			break;
+		}
+		else
+		{
+			new_move.to = target_pos;
+			new_move.capture = target_figure;
+			moves.push_back(new_move);
 		}
 	}
-	
-	// 3. straight up
-	if(row < 7)
+
+	// 3. Go south-west
+	for(i = row - 1, j = col - 1; (i >= 0) && (j >= 0); i--, j--)
 	{
-		// 2.2 middle
-		target_pos = pos + 8;
+		target_pos = i * 8 + j;
 		if((target_figure = this->square[target_pos]) != EMPTY)
 		{
-			if(IS_BLACK(target_figure) != IS_BLACK(figure))
+			if(IS_BLACK(target_figure) != Color)
 			{
-				new_move.capture = target_figure;
 				new_move.to = target_pos;
+				new_move.capture = target_figure;
 				captures.push_back(new_move);
 			}
+			
+			break;
 		}
 		else
 		{
 			new_move.to = target_pos;
 			new_move.capture = target_figure;
 			moves.push_back(new_move);
-		}	
+		}
 	}
-	
-	// 4. straight down
-	if(row > 0)
+
+	// 4. Go north-west
+	for(i = row + 1, j = col - 1; (i < 8) && (j >= 0); i++, j--)
 	{
-		// 2.2 middle
-		target_pos = pos - 8;
+		target_pos = i * 8 + j;
 		if((target_figure = this->square[target_pos]) != EMPTY)
 		{
-			if(IS_BLACK(target_figure) != IS_BLACK(figure))
+			if(IS_BLACK(target_figure) != Color)
 			{
-				new_move.capture = target_figure;
 				new_move.to = target_pos;
+				new_move.capture = target_figure;
 				captures.push_back(new_move);
 			}
+			
+			break;
 		}
 		else
 		{
 			new_move.to = target_pos;
 			new_move.capture = target_figure;
 			moves.push_back(new_move);
-		}	
+		}
 	}
+}
+
+template<int Color>
+void ChessBoard::getQueenMoves(int figure, int pos, list<Move> & moves, list<Move> & captures) const
+{
+	// Queen is just the "cartesian product" of Rook and Bishop
+	this->getRookMoves<Color>(figure, pos, moves, captures);
+	this->getBishopMoves<Color>(figure, pos, moves, captures);
+}
+
+
+template<int Color>
+void ChessBoard::getKingMoves(int figure, int pos, list<Move> & moves, list<Move> & captures)
+{
+	Move new_move;
+	int target_pos, target_figure;
 
-	// 5. Castling
-	if(!IS_MOVED(figure) && !isVulnerable(pos, figure))
+	// Of course, we only have to set this once
+	new_move.figure = figure;
+	new_move.from = pos;
+	new_move.promotion = EMPTY;
+
+	// 1. One step in every direction
+	addLeaperMoves<Color>(new_move, tables.king[pos], moves, captures);
+
+	// 2. Castling
+	if(!IS_MOVED(figure) && !isVulnerable<Color>(pos))
 	{
 		// short
-		target_pos = IS_BLACK(figure) ? F8 : F1;
-		if((this->square[target_pos] == EMPTY) && !isVulnerable(target_pos, figure))
+		target_pos = relative<Color>(F1);
+		if((this->square[target_pos] == EMPTY) && !isVulnerable<Color>(target_pos))
 		{
-			target_pos = IS_BLACK(figure) ? G8 : G1;
-			if((this->square[target_pos] == EMPTY) && !isVulnerable(target_pos, figure))
+			target_pos = relative<Color>(G1);
+			if((this->square[target_pos] == EMPTY) && !isVulnerable<Color>(target_pos))
 			{
-				target_pos = IS_BLACK(figure) ? H8 : H1;
+				target_pos = relative<Color>(H1);
 				target_figure = this->square[target_pos];
-				if(!IS_MOVED(target_figure) && (FIGURE(target_figure) == ROOK) && !isVulnerable(target_pos, figure))
+				if(!IS_MOVED(target_figure) && (FIGURE(target_figure) == ROOK))
 				{
-					if(IS_BLACK(target_figure) == IS_BLACK(figure))
+					if(IS_BLACK(target_figure) == Color)
 					{
 						new_move.capture = EMPTY;
-						new_move.to = IS_BLACK(figure) ? G8 : G1;
+						new_move.to = relative<Color>(G1);
 						moves.push_back(new_move);
 					}
 				}
 			}
 		}
 		
-		// long
-		target_pos = IS_BLACK(figure) ? B8 : B1;
-		if((this->square[target_pos] == EMPTY) && !isVulnerable(target_pos, figure))
+		// long, the king does not pass B1, so it may be attacked
+		target_pos = relative<Color>(B1);
+		if(this->square[target_pos] == EMPTY)
 		{
-			target_pos = IS_BLACK(figure) ? C8 : C1;
-			if((this->square[target_pos] == EMPTY) && !isVulnerable(target_pos, figure))
+			target_pos = relative<Color>(C1);
+			if((this->square[target_pos] == EMPTY) && !isVulnerable<Color>(target_pos))
 			{
-				target_pos = IS_BLACK(figure) ? D8 : D1;
-				if((this->square[target_pos] == EMPTY) && !isVulnerable(target_pos, figure))
+				target_pos = relative<Color>(D1);
+				if((this->square[target_pos] == EMPTY) && !isVulnerable<Color>(target_pos))
 				{
-					target_pos = IS_BLACK(figure) ? A8 : A1;
+					target_pos = relative<Color>(A1);
 					target_figure = this->square[target_pos];
-					if(!IS_MOVED(target_figure) && (FIGURE(target_figure) == ROOK) && !isVulnerable(target_pos, figure))
+					if(!IS_MOVED(target_figure) && (FIGURE(target_figure) == ROOK))
 					{
-						if(IS_BLACK(target_figure) == IS_BLACK(figure))
+						if(IS_BLACK(target_figure) == Color)
 						{
 							new_move.capture = EMPTY;
-							new_move.to = IS_BLACK(figure) ? C8 : C1;
+							new_move.to = relative<Color>(C1);
 							moves.push_back(new_move);
 						}
 					}
@@ -967,10 +1239,13 @@ void ChessBoard::getKingMoves(int figure, int pos, list<Move> & moves, list<Move
 	}
 }
 
-bool ChessBoard::isVulnerable(int pos, int figure) const
+template<int Color>
+bool ChessBoard::isVulnerable(int pos) const
 {
 	int target_pos, target_figure, row, col, i,j, end;
 
+	PERF_SCOPE(PerfIsVulnerable);
+
 	// Determine row and column
 	row = pos / 8;
 	col = pos % 8;
@@ -980,7 +1255,7 @@ bool ChessBoard::isVulnerable(int pos, int figure) const
 	{
 		if((target_figure = this->square[target_pos]) != EMPTY)
 		{
-			if(IS_BLACK(target_figure) != IS_BLACK(figure))
+			if(IS_BLACK(target_figure) != Color)
 			{
 				if((target_pos - pos) == 8)
 				{
@@ -1001,7 +1276,7 @@ bool ChessBoard::isVulnerable(int pos, int figure) const
 	{
 		if((target_figure = this->square[target_pos]) != EMPTY)
 		{
-			if(IS_BLACK(target_figure) != IS_BLACK(figure))
+			if(IS_BLACK(target_figure) != Color)
 			{
 				if((pos - target_pos) == 8)
 				{
@@ -1022,7 +1297,7 @@ bool ChessBoard::isVulnerable(int pos, int figure) const
 	{
 		if((target_figure = this->square[target_pos]) != EMPTY)
 		{
-			if(IS_BLACK(figure) != IS_BLACK(target_figure))
+			if(IS_BLACK(target_figure) != Color)
 			{
 				if((pos - target_pos) == 1)
 				{
@@ -1043,7 +1318,7 @@ bool ChessBoard::isVulnerable(int pos, int figure) const
 	{
 		if((target_figure = this->square[target_pos]) != EMPTY)
 		{
-			if(IS_BLACK(figure) != IS_BLACK(target_figure))
+			if(IS_BLACK(target_figure) != Color)
 			{
 				if((target_pos - pos) == 1)
 				{
@@ -1065,13 +1340,13 @@ bool ChessBoard::isVulnerable(int pos, int figure) const
 		target_pos = i * 8 + j;
 		if((target_figure = this->square[target_pos]) != EMPTY)
 		{
-			if(IS_BLACK(figure) != IS_BLACK(target_figure))
+			if(IS_BLACK(target_figure) != Color)
 			{
 				if((target_pos - pos) == 9)
 				{
 					if(FIGURE(target_figure) == KING)
 						return true;
-					else if(!IS_BLACK(figure) && (FIGURE(target_figure) == PAWN))
+					else if((Color == WHITE) && (FIGURE(target_figure) == PAWN))
 						return true;
 				}
 
@@ -1089,13 +1364,13 @@ bool ChessBoard::isVulnerable(int pos, int figure) const
 		target_pos = i * 8 + j;
 		if((target_figure = this->square[target_pos]) != EMPTY)
 		{
-			if(IS_BLACK(figure) != IS_BLACK(target_figure))
+			if(IS_BLACK(target_figure) != Color)
 			{
 				if((pos - target_pos) == 7)
 				{
 					if(FIGURE(target_figure) == KING)
 						return true;
-					else if(IS_BLACK(figure) && (FIGURE(target_figure) == PAWN))
+					else if((Color == BLACK) && (FIGURE(target_figure) == PAWN))
 						return true;
 				}
 
@@ -1113,13 +1388,13 @@ bool ChessBoard::isVulnerable(int pos, int figure) const
 		target_pos = i * 8 + j;
 		if((target_figure = this->square[target_pos]) != EMPTY)
 		{
-			if(IS_BLACK(figure) != IS_BLACK(target_figure))
+			if(IS_BLACK(target_figure) != Color)
 			{
 				if((pos - target_pos) == 9)
 				{
 					if(FIGURE(target_figure) == KING)
 						return true;
-					else if(IS_BLACK(figure) && (FIGURE(target_figure) == PAWN))
+					else if((Color == BLACK) && (FIGURE(target_figure) == PAWN))
 						return true;
 				}
 
@@ -1137,13 +1412,13 @@ bool ChessBoard::isVulnerable(int pos, int figure) const
 		target_pos = i * 8 + j;
 		if((target_figure = this->square[target_pos]) != EMPTY)
 		{
-			if(IS_BLACK(figure) != IS_BLACK(target_figure))
+			if(IS_BLACK(target_figure) != Color)
 			{
 				if((target_pos - pos) == 7)
 				{
 					if(FIGURE(target_figure) == KING)
 						return true;
-					else if(!IS_BLACK(figure) && (FIGURE(target_figure) == PAWN))
+					else if((Color == WHITE) && (FIGURE(target_figure) == PAWN))
 						return true;
 				}
 
@@ -1155,134 +1430,14 @@ bool ChessBoard::isVulnerable(int pos, int figure) const
 		}
 	}
 	
-	// 9. Look for Knights in upper positions
-	if(row < 6)
-	{
-		// right
-		if(col < 7)
-		{
-			target_pos = pos + 17;
-
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(figure) != IS_BLACK(target_figure))
-				{
-					if(FIGURE(target_figure) == KNIGHT) return true;
-				}
-			}
-		}
-		
-		// left
-		if(col > 0)
-		{
-			target_pos = pos + 15;
-		
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(figure) != IS_BLACK(target_figure))
-				{
-					if(FIGURE(target_figure) == KNIGHT) return true;
-				}
-			}		
-		}
-	}
-	
-	// 10. Look for Knights in lower positions
-	if(row > 1)
-	{
-		// right
-		if(col < 7)
-		{
-			target_pos = pos - 15;
-		
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(figure) != IS_BLACK(target_figure))
-				{
-					if(FIGURE(target_figure) == KNIGHT) return true;
-				}
-			}
-		}
-		
-		// left
-		if(col > 0)
-		{
-			target_pos = pos - 17;
-		
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(figure) != IS_BLACK(target_figure))
-				{
-					if(FIGURE(target_figure) == KNIGHT) return true;
-				}
-			}		
-		}
-	}
-
-	// 11. Look for Knights in right positions
-	if(col < 6)
+	// 9. Look for Knights
+	for(i = 0; i < tables.knight[pos].count; i++)
 	{
-		// up
-		if(row < 7)
-		{
-			target_pos = pos + 10;
-		
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(figure) != IS_BLACK(target_figure))
-				{
-					if(FIGURE(target_figure) == KNIGHT) return true;
-				}
-			}
-		}
-		
-		// down
-		if(row > 0)
-		{
-			target_pos = pos - 6;
-		
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(figure) != IS_BLACK(target_figure))
-				{
-					if(FIGURE(target_figure) == KNIGHT) return true;
-				}
-			}		
-		}
+		target_figure = this->square[(int)tables.knight[pos].squares[i]];
+		if((FIGURE(target_figure) == KNIGHT) && (IS_BLACK(target_figure) != Color))
+			return true;
 	}
 
-	// 12. Look for Knights in left positions
-	if(col > 1)
-	{
-		// up
-		if(row < 7)
-		{
-			target_pos = pos + 6;
-		
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(figure) != IS_BLACK(target_figure))
-				{
-					if(FIGURE(target_figure) == KNIGHT) return true;
-				}
-			}
-		}
-		
-		// down
-		if(row > 0)
-		{
-			target_pos = pos - 10;
-		
-			if((target_figure = this->square[target_pos]) != EMPTY)
-			{
-				if(IS_BLACK(figure) != IS_BLACK(target_figure))
-				{
-					if(FIGURE(target_figure) == KNIGHT) return true;
-				}
-			}		
-		}
-	}	
-
 	return false;
 }
 
@@ -1295,7 +1450,8 @@ bool ChessBoard::isValidMove(int color, Move & move)
 
 	for(list<Move>::iterator it = regulars.begin(); it != regulars.end() && !valid; ++it)
 	{
-		if(move.from == (*it).from && move.to == (*it).to)
+		if(move.from == (*it).from && move.to == (*it).to &&
+			((*it).promotion == EMPTY || (*it).promotion == move.promotion))
 		{
 			move = *it;
 
@@ -1309,6 +1465,45 @@ bool ChessBoard::isValidMove(int color, Move & move)
 	return valid;
 }
 
+bool ChessBoard::mayExposeKing(const Move & move, bool in_check) const
+{
+	int king_pos = IS_BLACK(move.figure) ? black_king_pos : white_king_pos;
+
+	if(in_check || FIGURE(move.figure) == KING || IS_PASSANT(move.capture))
+		return true;
+
+	// a piece leaving a line through the king may uncover an attack on it,
+	// one staying on that line keeps it covered
+	return (tables.line[king_pos][move.from] & ~tables.line[king_pos][move.to]) != 0;
+}
+
+bool ChessBoard::isRepetition(int count) const
+{
+	int i, end, n = history.size();
+
+	// no earlier position shares the bucket often enough
+	if(repetition_filter[hash & 1023] < count)
+		return false;
+
+	// positions with the same side to move since the last irreversible move
+	end = n - halfmove_clock;
+	if(end < 0)
+		end = 0;
+
+	for(i = n - 2; i >= end; i -= 2)
+	{
+		if(history[i].key == hash && --count == 0)
+			return true;
+	}
+
+	return false;
+}
+
+bool ChessBoard::isDraw(void) const
+{
+	return halfmove_clock >= 100 || isRepetition(2);
+}
+
 ChessPlayer::Status ChessBoard::getPlayerStatus(int color)
 {
 	bool king_vulnerable = false, can_move = false;
@@ -1335,194 +1530,176 @@ ChessPlayer::Status ChessBoard::getPlayerStatus(int color)
 		return ChessPlayer::Checkmate;
 	if(!king_vulnerable && !can_move)
 		return ChessPlayer::Stalemate;
+	if(isDraw())
+		return ChessPlayer::Draw;
 
 	return ChessPlayer::Normal;
 }
 
 void ChessBoard::move(const Move & move)
 {
+	HistoryEntry entry;
+
+	// maintenance moves only clear flags, everything else is recorded
+	if(move.from != move.to)
+	{
+		entry.key = hash;
+		entry.halfmove_clock = halfmove_clock;
+#ifdef COPY_MAKE
+		entry.black_king_pos = black_king_pos;
+		entry.white_king_pos = white_king_pos;
+		saved_squares.emplace_back();
+		memcpy(saved_squares.back().square, square, sizeof(square));
+#endif
+		history.push_back(entry);
+		repetition_filter[hash & 1023]++;
+
+		if(FIGURE(move.figure) == PAWN || move.capture != EMPTY)
+			halfmove_clock = 0;
+		else
+			halfmove_clock++;
+	}
+
 	// kings and pawns receive special treatment
 	switch(FIGURE(move.figure))
 	{
 		case KING:
-			moveKing(move);
+			if(IS_BLACK(move.figure))
+				moveKing<BLACK>(move);
+			else
+				moveKing<WHITE>(move);
 			break;
 		case PAWN:
 			if(move.to != move.from) {
-				movePawn(move);
+				if(IS_BLACK(move.figure))
+					movePawn<BLACK>(move);
+				else
+					movePawn<WHITE>(move);
 				break;
 			}
 		default:
-			this->square[(int)move.from] = EMPTY;
-			this->square[(int)move.to] = SET_MOVED(move.figure);
+			setSquare(move.from, EMPTY);
+			setSquare(move.to, SET_MOVED(move.figure));
 			break;
 	}
 }
 
 void ChessBoard::undoMove(const Move & move)
 {
+	// maintenance moves restore the flags of a single square
+	if(move.from == move.to)
+	{
+		setSquare(move.from, move.capture);
+		return;
+	}
+
+#ifdef COPY_MAKE
+	// copy back the board saved by move()
+	memcpy(square, saved_squares.back().square, sizeof(square));
+	black_king_pos = history.back().black_king_pos;
+	white_king_pos = history.back().white_king_pos;
+	saved_squares.pop_back();
+#else
 	// kings and pawns receive special treatment
 	switch(FIGURE(move.figure))
 	{
 		case KING:
-			undoMoveKing(move);
+			if(IS_BLACK(move.figure))
+				undoMoveKing<BLACK>(move);
+			else
+				undoMoveKing<WHITE>(move);
 			break;
 		case PAWN:
-			if(move.to != move.from) {
-				undoMovePawn(move);
-				break;
-			}
+			if(IS_BLACK(move.figure))
+				undoMovePawn<BLACK>(move);
+			else
+				undoMovePawn<WHITE>(move);
+			break;
 		default:
 			this->square[(int)move.from] = move.figure;
 			this->square[(int)move.to] = move.capture;
 			break;
 	}
+#endif
+
+	// restore key and clock of the previous position
+	hash = history.back().key;
+	halfmove_clock = history.back().halfmove_clock;
+	repetition_filter[hash & 1023]--;
+	history.pop_back();
 }
 
+template<int Color>
 void ChessBoard::movePawn(const Move & move)
 {
-	int capture_field;
-
 	// check for en-passant capture
-	if(IS_PASSANT(move.capture))
-	{
-		if(IS_BLACK(move.figure))
-		{
-			capture_field = move.to + 8;
-			if((move.from / 8) == 3)
-				this->square[capture_field] = EMPTY;
-		}
-		else
-		{
-			capture_field = move.to - 8;
-			if((move.from / 8) == 4)
-				this->square[capture_field] = EMPTY;
-		}
-	}
+	if(IS_PASSANT(move.capture) && (move.from / 8) == (Color == BLACK ? 3 : 4))
+		setSquare((Color == BLACK) ? move.to + 8 : move.to - 8, EMPTY);
 
-	this->square[(int)move.from] = EMPTY;
+	setSquare(move.from, EMPTY);
 
 	// mind pawn promotion
-	if(IS_BLACK(move.figure)) {
-		if(move.to / 8 == 0)
-			this->square[(int)move.to] = SET_MOVED(SET_BLACK(QUEEN));
-		else
-			this->square[(int)move.to] = SET_MOVED(move.figure);
-	}
-	else {
-		if(move.to / 8 == 7)
-			this->square[(int)move.to] = SET_MOVED(QUEEN);
-		else
-			this->square[(int)move.to] = SET_MOVED(move.figure);
-	}
+	if(move.promotion == EMPTY)
+		setSquare(move.to, SET_MOVED(move.figure));
+	else
+		setSquare(move.to, SET_MOVED(Color | move.promotion));
 }
 
+template<int Color>
 void ChessBoard::undoMovePawn(const Move & move)
 {
-	int capture_field;
-
 	this->square[(int)move.from] = CLEAR_PASSANT(move.figure);
 
 	// check for en-passant capture
-	if(IS_PASSANT(move.capture))
-	{
-		if(IS_BLACK(move.figure))
-		{
-			capture_field = move.to + 8;
-			if(move.from / 8 == 3) {
-				this->square[capture_field] = move.capture;
-				this->square[(int)move.to] = EMPTY;
-			}
-			else {
-				this->square[(int)move.to] = move.capture;
-			}
-		}
-		else
-		{
-			capture_field = move.to - 8;
-			if(move.from / 8 == 4) {
-				this->square[capture_field] = move.capture;
-				this->square[(int)move.to] = EMPTY;
-			}
-			else {
-				this->square[(int)move.to] = move.capture;
-			}
-		}
+	if(IS_PASSANT(move.capture) && (move.from / 8) == (Color == BLACK ? 3 : 4)) {
+		this->square[(Color == BLACK) ? move.to + 8 : move.to - 8] = move.capture;
+		this->square[(int)move.to] = EMPTY;
 	}
-	else
-	{
+	else {
 		this->square[(int)move.to] = move.capture;
 	}
 }
 
+template<int Color>
 void ChessBoard::moveKing(const Move & move)
 {
 	// check for castling
 	if(!IS_MOVED(move.figure))
 	{
-		switch(move.to)
-		{
-			case G1:
-				this->square[H1] = EMPTY;
-				this->square[F1] = SET_MOVED(ROOK);
-				break;
-			case G8:
-				this->square[H8] = EMPTY;
-				this->square[F8] = SET_MOVED(SET_BLACK(ROOK));
-				break;
-			case C1:
-				this->square[A1] = EMPTY;
-				this->square[D1] = SET_MOVED(ROOK);
-				break;
-			case C8:
-				this->square[A8] = EMPTY;
-				this->square[D8] = SET_MOVED(SET_BLACK(ROOK));
-				break;
-			default:
-				break;
+		if(move.to == relative<Color>(G1)) {
+			setSquare(relative<Color>(H1), EMPTY);
+			setSquare(relative<Color>(F1), SET_MOVED(Color | ROOK));
+		}
+		else if(move.to == relative<Color>(C1)) {
+			setSquare(relative<Color>(A1), EMPTY);
+			setSquare(relative<Color>(D1), SET_MOVED(Color | ROOK));
 		}
 	}
 
 	// regular move
-	this->square[(int)move.from] = EMPTY;
-	this->square[(int)move.to] = SET_MOVED(move.figure);
-	
+	setSquare(move.from, EMPTY);
+	setSquare(move.to, SET_MOVED(move.figure));
+
 	// update king position variable
-	if(IS_BLACK(move.figure)) {
+	if(Color == BLACK)
 		black_king_pos = move.to;
-	}
-	else {
+	else
 		white_king_pos = move.to;
-	}
 }
 
+template<int Color>
 void ChessBoard::undoMoveKing(const Move & move)
 {
-	// check for castling
+	// check for castling, the rook goes back to its corner
 	if(!IS_MOVED(move.figure))
 	{
-		// set rook depending on
-		// king's target field
-		switch(move.to)
-		{
-			case G1:
-				this->square[H1] = ROOK;
-				this->square[F1] = EMPTY;
-				break;
-			case G8:
-				this->square[H8] = SET_BLACK(ROOK);
-				this->square[F8] = EMPTY;
-				break;
-			case C1:
-				this->square[A1] = ROOK;
-				this->square[D1] = EMPTY;
-				break;
-			case C8:
-				this->square[A8] = SET_BLACK(ROOK);
-				this->square[D8] = EMPTY;
-				break;
-			default:
-				break;
+		if(move.to == relative<Color>(G1)) {
+			this->square[relative<Color>(H1)] = Color | ROOK;
+			this->square[relative<Color>(F1)] = EMPTY;
+		}
+		else if(move.to == relative<Color>(C1)) {
+			this->square[relative<Color>(A1)] = Color | ROOK;
+			this->square[relative<Color>(D1)] = EMPTY;
 		}
 	}
 
@@ -1531,10 +1708,40 @@ void ChessBoard::undoMoveKing(const Move & move)
 	this->square[(int)move.to] = move.capture;
 
 	// update king position variable
-	if(IS_BLACK(move.figure)) {
+	if(Color == BLACK)
 		black_king_pos = move.from;
-	}
-	else {
+	else
 		white_king_pos = move.from;
-	}
 }
+
+uint64_t ChessBoard::getKey(int color) const
+{
+	return color ? hash ^ zobrist.black : hash;
+}
+
+void ChessBoard::setSquare(int pos, int figure)
+{
+	hash ^= zobristKey(pos, this->square[pos]) ^ zobristKey(pos, figure);
+	this->square[pos] = figure;
+}
+
+void ChessBoard::resetHistory(void)
+{
+	int pos;
+
+	hash = 0;
+	for(pos = 0; pos < 64; pos++)
+		hash ^= zobristKey(pos, this->square[pos]);
+
+	history.clear();
+#ifdef COPY_MAKE
+	saved_squares.clear();
+#endif
+	memset((void*)repetition_filter, 0, sizeof(repetition_filter));
+}
+
+// used by the dispatchers in chessboard.h
+template void ChessBoard::getMoves<WHITE>(list<Move> &, list<Move> &, list<Move> &);
+template void ChessBoard::getMoves<BLACK>(list<Move> &, list<Move> &, list<Move> &);
+template bool ChessBoard::isVulnerable<WHITE>(int) const;
+template bool ChessBoard::isVulnerable<BLACK>(int) const;
@@ -1,6 +1,9 @@
 #ifndef CHESS_BOARD_H_INCLUDED
 #define CHESS_BOARD_H_INCLUDED
 
+#include <stdint.h>
+#include <cstring>
+#include <vector>
 #include "chessplayer.h"
 
 // Pieces defined in lower 4 bits
@@ -37,24 +40,129 @@
 #define BLACK 0x10
 #define TOGGLE_COLOR(x) (0x10 ^ x)
 
+// Longest position in Forsyth-Edwards Notation written by toFEN
+#define FEN_LENGTH 96
+
+/*
+* A move packed into 32 bits, so it is copied and compared like an int.
+*/
 struct Move
 {
 	/*
 	* Prints sth. like "Black queen from D8 to D7."
 	*/
 	void print(void) const;
+
+	/*
+	* Writes sth. like "d8d7" or "e7e8n" to buf, which needs room for 6
+	* chars.
+	*/
+	void toString(char * buf) const;
 	
 	/*
 	* True if moves are equal.
 	*/
 	bool operator==(const Move & b) const;
 
-	char figure;	// figure which is moved
-	char from, to;	// board is seen one-dimensional
-	char capture;	// piece that resides at destination square
+	/*
+	* 16 bit form for storage in hash entries and killer slots. It keeps
+	* origin (bits 0-5), destination (bits 6-11), promotion piece (bits
+	* 12-14) and a capture flag (bit 15), which identifies the move among
+	* all moves of a position.
+	*/
+	uint16_t pack(void) const;
+
+	unsigned figure : 8;	// figure which is moved
+	unsigned from : 6;	// board is seen one-dimensional
+	unsigned to : 6;
+	unsigned capture : 8;	// piece that resides at destination square
+	unsigned promotion : 4;	// piece a pawn turns into, EMPTY otherwise
+};
+
+inline bool Move::operator==(const Move & b) const
+{
+	uint32_t x, y;
+
+	// no padding bits, so the whole word can be compared at once
+	memcpy(&x, this, sizeof(x));
+	memcpy(&y, &b, sizeof(y));
+
+	return x == y;
+}
+
+inline uint16_t Move::pack(void) const
+{
+	return from | (to << 6) | (promotion << 12) | ((capture != EMPTY) << 15);
+}
+
+/*
+* A position in 32 bytes for storing positions by the million. Occupied
+* squares are marked in occupancy (A1 is bit 0), their pieces follow in
+* square order as 4 bit codes, the low nibble first: the figure type, plus
+* 8 for black pieces.
+*/
+struct PackedBoard
+{
+	uint64_t occupancy;
+	uint8_t pieces[16];
+	uint8_t flags;			// side to move and castling rights, see below
+	uint8_t passant;		// en passant target square, 0 if none
+	uint8_t halfmove_clock;
+	uint8_t reserved[5];	// zero
+};
+
+// Bits of PackedBoard::flags
+#define PACKED_BLACK		0x01	// black to move
+#define PACKED_WHITE_SHORT	0x02	// castling rights
+#define PACKED_WHITE_LONG	0x04
+#define PACKED_BLACK_SHORT	0x08
+#define PACKED_BLACK_LONG	0x10
+
+/*
+* The squares and kings. In copy-make mode (compiled with -DCOPY_MAKE) the
+* squares start a cache line, so saving them before every move and copying
+* them back in undoMove moves exactly one line.
+*/
+#ifdef COPY_MAKE
+struct alignas(64) BoardState
+#else
+struct BoardState
+#endif
+{
+	// THE BOARD ITSELF
+	char square[8*8];
+
+	// to keep track of the kings
+	char black_king_pos;
+	char white_king_pos;
+};
+
+/*
+* Everything needed to detect repetitions and to take a move back. In
+* copy-make mode the squares before the move are saved apart, in one cache
+* line, and the kings here.
+*/
+struct HistoryEntry
+{
+	uint64_t key;		// position key before the move
+	int halfmove_clock;	// plies since the last capture or pawn move
+#ifdef COPY_MAKE
+	char black_king_pos;
+	char white_king_pos;
+#endif
+};
+
+#ifdef COPY_MAKE
+struct alignas(64) SavedSquares
+{
+	char square[8*8];
 };
+#endif
 
-struct ChessBoard
+// Lookup table of knight and king steps, see chessboard.cpp
+struct LeaperTargets;
+
+struct ChessBoard: public BoardState
 {
 	enum Position {
 		A1 = 0, B1, C1, D1, E1, F1, G1, H1,
@@ -84,35 +192,87 @@ struct ChessBoard
 	*/
 	void initDefaultSetup(void);
 
+	/*
+	* Initialize board from a position in Forsyth-Edwards Notation. The side
+	* to move is stored in color. Returns false if the string is malformed.
+	*/
+	bool initFEN(const char * fen, int & color);
+
+	/*
+	* Initialize board from its packed form, the side to move is stored in
+	* color. Returns false if the position has no kings, more than 32
+	* pieces or castling rights without king and rook on their squares.
+	*/
+	bool initPacked(const PackedBoard & packed, int & color);
+
+	/*
+	* Packs the position with color to move. Like a FEN it keeps the
+	* castling rights, en passant target and halfmove clock, not the game
+	* history.
+	*/
+	void pack(int color, PackedBoard & packed) const;
+
+	/*
+	* Writes the position with color to move in Forsyth-Edwards Notation
+	* to fen, which needs room for FEN_LENGTH chars. The move number is
+	* not known and always 1.
+	*/
+	void toFEN(int color, char * fen) const;
+
 	/*
 	* Generates all moves for one side.
 	*/
 	void getMoves(int color, std::list<Move> & moves,
 		std::list<Move> & captures, std::list<Move> & null_moves);
 
+	/*
+	* The same for a side known at compile time. The generators below have
+	* such a version each, in which all tests of the color are resolved by
+	* the compiler.
+	*/
+	template<int Color>
+	void getMoves(std::list<Move> & moves, std::list<Move> & captures,
+		std::list<Move> & null_moves);
+
 	/*
 	* All possible moves for a pawn piece.
 	*/
 	void getPawnMoves(int figure, int pos, std::list<Move> & moves,
 		std::list<Move> & captures, std::list<Move> & null_moves) const;
+
+	template<int Color>
+	void getPawnMoves(int figure, int pos, std::list<Move> & moves,
+		std::list<Move> & captures, std::list<Move> & null_moves) const;
 	
 	/*
 	* All possible moves for a rook piece.
 	*/
 	void getRookMoves(int figure, int pos, std::list<Move> & moves,
 		std::list<Move> & captures) const;
+
+	template<int Color>
+	void getRookMoves(int figure, int pos, std::list<Move> & moves,
+		std::list<Move> & captures) const;
 	
 	/*
 	* All possible moves for a knight piece.
 	*/
 	void getKnightMoves(int figure, int pos, std::list<Move> & moves,
 		std::list<Move> & captures) const;
+
+	template<int Color>
+	void getKnightMoves(int figure, int pos, std::list<Move> & moves,
+		std::list<Move> & captures) const;
 	
 	/*
 	* All possible moves for a bishop piece.
 	*/
 	void getBishopMoves(int figure, int pos, std::list<Move> & moves,
 		std::list<Move> & captures) const;
+
+	template<int Color>
+	void getBishopMoves(int figure, int pos, std::list<Move> & moves,
+		std::list<Move> & captures) const;
 	
 	/*
 	* All possible moves for a queen piece.
@@ -120,12 +280,28 @@ struct ChessBoard
 	void getQueenMoves(int figure, int pos, std::list<Move> & moves,
 		std::list<Move> & captures) const;
 
+	template<int Color>
+	void getQueenMoves(int figure, int pos, std::list<Move> & moves,
+		std::list<Move> & captures) const;
+
 	/*
 	* All possible moves for a king piece.
 	*/
 	void getKingMoves(int figure, int pos, std::list<Move> & moves,
 		std::list<Move> & captures);
 
+	template<int Color>
+	void getKingMoves(int figure, int pos, std::list<Move> & moves,
+		std::list<Move> & captures);
+
+	/*
+	* Knight and king steps to the squares in targets. new_move has figure
+	* and origin set already.
+	*/
+	template<int Color>
+	void addLeaperMoves(Move & new_move, const LeaperTargets & targets,
+		std::list<Move> & moves, std::list<Move> & captures) const;
+
 	/*
 	* Returns true, if the square given by pos is vulnerable to the opponent.
 	* This is used to determine if castling is legal or if kings are in check.
@@ -133,13 +309,36 @@ struct ChessBoard
 	*/
 	bool isVulnerable(int pos, int color) const;
 
+	template<int Color>
+	bool isVulnerable(int pos) const;
+
+	/*
+	* False if move cannot leave the own king in check, so testing it with
+	* isVulnerable can be skipped: the king was not in check before, it
+	* does not move itself and no piece leaves a line through it.
+	*/
+	bool mayExposeKing(const Move & move, bool in_check) const;
+
 	/*
 	* True if move is a valid move for player of given color. Please note, that
 	* a move that puts the player's own king in check, is also treated as
-	* invalid.
+	* invalid. Pawns reaching the last rank turn into move.promotion.
 	*/
 	bool isValidMove(int color, Move & move);
 
+	/*
+	* True if the current position occurred at least count times before
+	* since the last capture or pawn move. A bucket counter per key lets
+	* most calls return without walking the history.
+	*/
+	bool isRepetition(int count = 1) const;
+
+	/*
+	* True if the game is drawn by threefold repetition or the fifty-move
+	* rule.
+	*/
+	bool isDraw(void) const;
+
 	/*
 	* Returns the status of player of given color. This method is not declared
 	* const, because it needs to simulate moves on the board to draw a
@@ -153,18 +352,59 @@ struct ChessBoard
 	void move(const Move & move);
 	void undoMove(const Move & move);
 
-	void movePawn(const Move & move);
-	void undoMovePawn(const Move & move);
+	template<int Color> void movePawn(const Move & move);
+	template<int Color> void undoMovePawn(const Move & move);
 
-	void moveKing(const Move & move);
-	void undoMoveKing(const Move & move);
+	template<int Color> void moveKing(const Move & move);
+	template<int Color> void undoMoveKing(const Move & move);
 
-	// THE BOARD ITSELF
-	char square[8*8];
+	/*
+	* Position key including the side to move
+	*/
+	uint64_t getKey(int color) const;
 
-	// to keep track of the kings
-	char black_king_pos;
-	char white_king_pos;
+	/*
+	* Changes a square and keeps the position key up to date.
+	*/
+	void setSquare(int pos, int figure);
+
+	/*
+	* Recompute position key from scratch and forget the game history.
+	*/
+	void resetHistory(void);
+
+	// zobrist key of the position, updated incrementally
+	uint64_t hash;
+
+	// plies since the last capture or pawn move
+	int halfmove_clock;
+
+	// one entry per move played, undone moves are popped, preallocated
+	// for a long game plus search
+	std::vector<HistoryEntry> history;
+
+#ifdef COPY_MAKE
+	// squares before every move in history
+	std::vector<SavedSquares> saved_squares;
+#endif
+
+	// number of history entries per bucket of key bits
+	uint16_t repetition_filter[1024];
 };
 
+inline void ChessBoard::getMoves(int color, std::list<Move> & moves,
+	std::list<Move> & captures, std::list<Move> & null_moves)
+{
+	// the only test of the color, once per position
+	if(color)
+		getMoves<BLACK>(moves, captures, null_moves);
+	else
+		getMoves<WHITE>(moves, captures, null_moves);
+}
+
+inline bool ChessBoard::isVulnerable(int pos, int color) const
+{
+	return color ? isVulnerable<BLACK>(pos) : isVulnerable<WHITE>(pos);
+}
+
 #endif
@@ -8,7 +8,7 @@ class ChessPlayer
 {
 	public:
 
-		enum Status { Normal, InCheck, Stalemate, Checkmate };
+		enum Status { Normal, InCheck, Stalemate, Checkmate, Draw };
 
 		ChessPlayer(int color)
 		 : color(color)
@@ -19,7 +19,7 @@ class ChessPlayer
 		/*
 		* Ask player what to do next
 		*/
-		virtual bool getMove(ChessBoard & board, Move & move) const = 0;
+		virtual bool getMove(ChessBoard & board, Move & move) = 0;
 
 	protected:
 
@@ -0,0 +1,70 @@
+#include "evalcache.h"
+#include "placement.h"
+
+// Upper key bits identify the position, the lower ones pick the slot
+#define KEY_MASK 0xFFFFFFFF00000000ULL
+
+// Score of cleared slots, no evaluation comes near it, so a slot holding
+// it is empty whatever its key bits
+#define EMPTY_SLOT 0x80000000ULL
+
+EvalCache::EvalCache(unsigned long entries)
+{
+	unsigned long size = 1;
+
+	while((size << 1) <= entries)
+		size <<= 1;
+
+	slots = (uint64_t*)allocLarge(size * sizeof(uint64_t));
+	mask = size - 1;
+
+	clear();
+}
+
+EvalCache::~EvalCache()
+{
+	freeLarge((void*)slots, sizeof(uint64_t) * (mask + 1));
+}
+
+bool EvalCache::probe(uint64_t key, int & score)
+{
+	uint64_t slot = slots[key & mask];
+
+	probes++;
+
+	if((slot & KEY_MASK) != (key & KEY_MASK) || (slot & ~KEY_MASK) == EMPTY_SLOT)
+		return false;
+
+	hits++;
+	score = (int)(int32_t)(uint32_t)slot;
+
+	return true;
+}
+
+void EvalCache::store(uint64_t key, int score)
+{
+	slots[key & mask] = (key & KEY_MASK) | (uint32_t)score;
+}
+
+void EvalCache::clear(void)
+{
+	for(uint64_t i = 0; i <= mask; i++)
+		slots[i] = EMPTY_SLOT;
+	probes = 0;
+	hits = 0;
+}
+
+double EvalCache::getHitRate(void) const
+{
+	return probes ? (double)hits / probes : 0.0;
+}
+
+uint64_t EvalCache::getProbes(void) const
+{
+	return probes;
+}
+
+uint64_t EvalCache::getHits(void) const
+{
+	return hits;
+}
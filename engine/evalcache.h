@@ -0,0 +1,55 @@
+#ifndef EVAL_CACHE_H_INCLUDED
+#define EVAL_CACHE_H_INCLUDED
+
+#include <stdint.h>
+
+/*
+* Direct-mapped cache of static evaluations, indexed by position key. The
+* upper half of the key and the score share one 64 bit word, so a slot is
+* written and read at once and needs no locks.
+*/
+class EvalCache
+{
+	public:
+
+		/*
+		* Number of entries is rounded down to a power of two
+		*/
+		EvalCache(unsigned long entries);
+
+		~EvalCache();
+
+		/*
+		* True if the score of the position with this key was found
+		*/
+		bool probe(uint64_t key, int & score);
+
+		/*
+		* Remember the score of a position
+		*/
+		void store(uint64_t key, int score);
+
+		/*
+		* Forget everything
+		*/
+		void clear(void);
+
+		/*
+		* Share of probes that found a score since the cache was created
+		*/
+		double getHitRate(void) const;
+
+		uint64_t getProbes(void) const;
+		uint64_t getHits(void) const;
+
+	protected:
+
+		uint64_t * slots;
+		uint64_t mask;
+
+		// statistics to size the cache
+		uint64_t probes;
+		uint64_t hits;
+};
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef EVAL_PARAMS_H_INCLUDED
+#define EVAL_PARAMS_H_INCLUDED
+
+// Evaluation parameters. tools/tuner writes this file, hand-picked values
+// until it is run.
+
+#define PAWN_VALUE    30	// 8x
+#define ROOK_VALUE    90	// 2x
+#define KNIGHT_VALUE  85	// 2x
+#define BISHOP_VALUE  84	// 2x
+#define QUEEN_VALUE  300	// 1x
+
+#endif
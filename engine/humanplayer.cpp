@@ -15,7 +15,7 @@ HumanPlayer::HumanPlayer(int color)
 HumanPlayer::~HumanPlayer()
 {}
 
-bool HumanPlayer::getMove(ChessBoard & board, Move & move) const
+bool HumanPlayer::getMove(ChessBoard & board, Move & move)
 {
 	list<Move> regulars, nulls;
 	char * input;
@@ -130,6 +130,23 @@ bool HumanPlayer::processInput(char * buf, Move & move) const
 			move.to = n * 8 + l;
 	}
 
+	// optional promotion piece as in "e7e8n", queen by default
+	switch(tolower(buf[i]))
+	{
+		case 'r':
+			move.promotion = ROOK;
+			break;
+		case 'n':
+			move.promotion = KNIGHT;
+			break;
+		case 'b':
+			move.promotion = BISHOP;
+			break;
+		default:
+			move.promotion = QUEEN;
+			break;
+	}
+
 	free(buf);
 	return true;
 }
@@ -17,7 +17,7 @@ class HumanPlayer: public ChessPlayer {
 		/*
 		* Ask player what to do
 		*/
-		bool getMove(ChessBoard & board, Move & move) const;
+		bool getMove(ChessBoard & board, Move & move);
 		
 		/*
 		* Read input from stdin
@@ -25,7 +25,8 @@ class HumanPlayer: public ChessPlayer {
 		char * readInput(void) const;
 		
 		/*
-		* Process input. Frees buffer allocated by readInput()
+		* Process input like "b1c3" or "e7e8n" for an underpromotion. Frees
+		* buffer allocated by readInput()
 		*/
 		bool processInput(char * buf, Move & move) const;
 
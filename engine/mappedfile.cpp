@@ -0,0 +1,71 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mappedfile.h"
+
+MappedFile::MappedFile()
+ : data(NULL),
+   bytes(0)
+{}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const char * filename)
+{
+	struct stat st;
+	void * p;
+	int fd;
+
+	close();
+
+	if((fd = ::open(filename, O_RDONLY)) < 0)
+		return false;
+
+	if(fstat(fd, &st) != 0) {
+		::close(fd);
+		return false;
+	}
+
+	// an empty file cannot be mapped, but is a valid empty file
+	if(st.st_size == 0) {
+		::close(fd);
+		return true;
+	}
+
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+
+	if(p == MAP_FAILED)
+		return false;
+
+	// read ahead aggressively and drop pages behind
+	madvise(p, st.st_size, MADV_SEQUENTIAL);
+
+	data = p;
+	bytes = st.st_size;
+
+	return true;
+}
+
+void MappedFile::close(void)
+{
+	if(data != NULL)
+		munmap(data, bytes);
+
+	data = NULL;
+	bytes = 0;
+}
+
+const void * MappedFile::getData(void) const
+{
+	return data;
+}
+
+size_t MappedFile::getBytes(void) const
+{
+	return bytes;
+}
@@ -0,0 +1,70 @@
+#ifndef MAPPED_FILE_H_INCLUDED
+#define MAPPED_FILE_H_INCLUDED
+
+#include <stddef.h>
+
+/*
+* A whole file mapped read-only into memory, with the kernel told it is
+* read front to back. Nothing is copied or parsed, pages come in as they
+* are touched.
+*/
+class MappedFile
+{
+	public:
+
+		MappedFile();
+		~MappedFile();
+
+		MappedFile(const MappedFile &) = delete;
+		MappedFile & operator=(const MappedFile &) = delete;
+
+		/*
+		* Map the file, an open one is closed first. Returns false if it
+		* cannot be opened or mapped.
+		*/
+		bool open(const char * filename);
+
+		void close(void);
+
+		const void * getData(void) const;
+		size_t getBytes(void) const;
+
+	protected:
+
+		void * data;
+		size_t bytes;
+};
+
+/*
+* A mapped file of fixed size records, which are used in place.
+*/
+template<typename T>
+class RecordFile: public MappedFile
+{
+	public:
+
+		/*
+		* Also fails if the file is no whole number of records long.
+		*/
+		bool open(const char * filename)
+		{
+			if(!MappedFile::open(filename))
+				return false;
+
+			if(bytes % sizeof(T) != 0) {
+				close();
+				return false;
+			}
+
+			return true;
+		}
+
+		size_t size(void) const { return bytes / sizeof(T); }
+
+		const T * begin(void) const { return (const T *)data; }
+		const T * end(void) const { return begin() + size(); }
+
+		const T & operator[](size_t i) const { return begin()[i]; }
+};
+
+#endif
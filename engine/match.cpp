@@ -0,0 +1,358 @@
+#include <cmath>
+#include <cstdio>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <list>
+#include <thread>
+#include "match.h"
+#include "aiplayer.h"
+#include "chessboard.h"
+#include "placement.h"
+
+using namespace std;
+
+// A handful of common openings, a few plies deep
+static const char * default_openings[] = {
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+	"rnbqkb1r/pppp1ppp/5n2/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+	"rnbqkbnr/pp1ppppp/8/2p5/4P3/8/PPPP1PPP/RNBQKBNR w KQkq c6 0 2",
+	"rnbqkbnr/pppp1ppp/4p3/8/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 0 2",
+	"rnbqkbnr/pp1ppppp/2p5/8/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 0 2",
+	"rnbqkbnr/ppp1pppp/8/3p4/4P3/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 2",
+	"rnbqkbnr/ppp1pppp/8/3p4/2PP4/8/PP2PPPP/RNBQKBNR b KQkq c3 0 2",
+	"rnbqkb1r/pppp1ppp/4pn2/8/2PP4/8/PP2PPPP/RNBQKBNR w KQkq - 0 3",
+	"rnbqkb1r/pppppp1p/5np1/8/2PP4/8/PP2PPPP/RNBQKBNR w KQkq - 0 3",
+	"rnbqkbnr/pppp1ppp/8/4p3/2P5/8/PP1PPPPP/RNBQKBNR w KQkq e6 0 2",
+	"rnbqkbnr/ppp1pppp/8/3p4/8/5N2/PPPPPPPP/RNBQKB1R w KQkq d6 0 2"
+};
+
+/*
+* Expected score for an elo difference
+*/
+static double eloToScore(double elo)
+{
+	return 1.0 / (1.0 + pow(10.0, -elo / 400.0));
+}
+
+/*
+* Elo difference for an expected score
+*/
+static double scoreToElo(double score)
+{
+	if(score <= 0.0)
+		return -HUGE_VAL;
+	if(score >= 1.0)
+		return HUGE_VAL;
+	return -400.0 * log10(1.0 / score - 1.0);
+}
+
+Match::Match(const EngineConfig & first, const EngineConfig & second)
+ : first(first),
+   second(second),
+   max_plies(400),
+   seed(time(NULL)),
+   sprt(false),
+   elo0(0.0), elo1(5.0), alpha(0.05), beta(0.05),
+   next_game(0), total_games(0),
+   wins(0), draws(0), losses(0),
+   stop(false)
+{}
+
+int Match::loadOpenings(const char * filename)
+{
+	ChessBoard board;
+	char line[256];
+	int color, len;
+	FILE * fp;
+
+	if((fp = fopen(filename, "r")) == NULL)
+		return -1;
+
+	openings.clear();
+
+	while(fgets(line, sizeof(line), fp))
+	{
+		// strip line break
+		len = strlen(line);
+		while(len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			line[--len] = '\0';
+
+		if(len == 0 || line[0] == '#')
+			continue;
+
+		if(!board.initFEN(line, color)) {
+			fprintf(stderr, "Match::loadOpenings(): skipping invalid FEN '%s'\n", line);
+			continue;
+		}
+
+		openings.push_back(line);
+	}
+
+	fclose(fp);
+	return openings.size();
+}
+
+void Match::useDefaultOpenings(void)
+{
+	openings.assign(default_openings,
+		default_openings + sizeof(default_openings) / sizeof(default_openings[0]));
+}
+
+void Match::setSPRT(double elo0, double elo1, double alpha, double beta)
+{
+	this->sprt = true;
+	this->elo0 = elo0;
+	this->elo1 = elo1;
+	this->alpha = alpha;
+	this->beta = beta;
+}
+
+void Match::setMaxPlies(int max_plies)
+{
+	this->max_plies = max_plies;
+}
+
+void Match::setSeed(unsigned int seed)
+{
+	this->seed = seed;
+}
+
+void Match::run(int games, int threads)
+{
+	vector<thread> workers;
+	int i;
+
+	if(openings.empty())
+		useDefaultOpenings();
+
+	next_game = 0;
+	total_games = games;
+	wins = draws = losses = 0;
+	stop = false;
+
+	printf("Match seed %u\n", seed);
+	fflush(stdout);
+
+	for(i = 0; i < threads; i++)
+		workers.push_back(thread(&Match::worker, this, i, threads));
+
+	for(i = 0; i < threads; i++)
+		workers[i].join();
+}
+
+void Match::worker(int index, int count)
+{
+	const char * fen;
+	int game, played;
+	unsigned int game_seed;
+	Result result;
+	double margin, value;
+
+	// the players of a game are created here, so their tables end up on
+	// the memory of the worker's CPU
+	bindThread(index, count);
+
+	for(;;)
+	{
+		// fetch next game
+		{
+			lock_guard<std::mutex> guard(lock);
+			if(stop || next_game >= total_games)
+				return;
+			game = next_game++;
+		}
+
+		// each opening is played twice, engines swap colors
+		fen = openings[(game / 2) % openings.size()].c_str();
+		game_seed = seed + 2 * game;
+		if(game % 2 == 0) {
+			result = playGame(first, second, fen, max_plies, game_seed);
+		}
+		else {
+			result = playGame(second, first, fen, max_plies, game_seed);
+			result = Result(Win - result);
+		}
+
+		// book keeping
+		{
+			lock_guard<std::mutex> guard(lock);
+			if(stop)
+				return;
+
+			switch(result)
+			{
+				case Win:
+					wins++;
+					break;
+				case Draw:
+					draws++;
+					break;
+				case Loss:
+					losses++;
+					break;
+			}
+
+			played = wins + draws + losses;
+			value = elo(margin);
+			printf("Score after %d games: %d - %d - %d  Elo %.1f +/- %.1f",
+				played, wins, losses, draws, value, margin);
+
+			if(sprt) {
+				value = llr();
+				printf("  LLR %.2f [%.2f, %.2f]", value,
+					log(beta / (1.0 - alpha)), log((1.0 - beta) / alpha));
+
+				if(value >= log((1.0 - beta) / alpha) || value <= log(beta / (1.0 - alpha)))
+					stop = true;
+			}
+
+			printf("\n");
+			fflush(stdout);
+		}
+	}
+}
+
+void Match::printResult(void) const
+{
+	double value, margin;
+	int played = wins + draws + losses;
+
+	value = elo(margin);
+
+	printf("\nGames: %d  Wins: %d  Losses: %d  Draws: %d  Seed: %u\n",
+		played, wins, losses, draws, seed);
+	printf("Elo difference: %.1f +/- %.1f (95%%)\n", value, margin);
+
+	if(sprt) {
+		value = llr();
+		printf("SPRT elo0=%.1f elo1=%.1f alpha=%.2f beta=%.2f: LLR %.2f, ",
+			elo0, elo1, alpha, beta, value);
+		if(value >= log((1.0 - beta) / alpha))
+			printf("H1 accepted\n");
+		else if(value <= log(beta / (1.0 - alpha)))
+			printf("H0 accepted\n");
+		else
+			printf("inconclusive\n");
+	}
+}
+
+Match::Result Match::playGame(const EngineConfig & white_config,
+	const EngineConfig & black_config, const char * fen, int max_plies,
+	unsigned int seed)
+{
+	ChessBoard board;
+	list<Move> regulars, nulls;
+	Move move;
+	int turn, ply, clock[2];
+	bool found;
+
+	if(!board.initFEN(fen, turn))
+		return Draw;
+
+	AIPlayer white(WHITE, white_config.search_depth);
+	AIPlayer black(BLACK, black_config.search_depth);
+
+	white.setSeed(seed);
+	black.setSeed(seed + 1);
+
+	clock[0] = white_config.time;
+	clock[1] = black_config.time;
+
+	for(ply = 0; ply < max_plies; ply++)
+	{
+		// adjudicate
+		switch(board.getPlayerStatus(turn))
+		{
+			case ChessPlayer::Checkmate:
+				return turn ? Win : Loss;
+			case ChessPlayer::Stalemate:
+			case ChessPlayer::Draw:
+				return Draw;
+			default:
+				break;
+		}
+
+		// query player's choice on the clock
+		const EngineConfig & config = turn ? black_config : white_config;
+		AIPlayer & player = turn ? black : white;
+		int & remaining = clock[turn ? 1 : 0];
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+		player.setClock(remaining, config.increment, 0);
+		found = player.getMove(board, move);
+
+		if(config.time > 0) {
+			remaining -= chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+
+			// lost on time
+			if(remaining <= 0)
+				return turn ? Win : Loss;
+
+			remaining += config.increment;
+		}
+
+		if(!found)
+			return turn ? Win : Loss;
+
+		// execute maintenance moves and the move itself
+		regulars.clear();
+		nulls.clear();
+		board.getMoves(turn, regulars, regulars, nulls);
+
+		for(list<Move>::iterator it = nulls.begin(); it != nulls.end(); ++it)
+			board.move(*it);
+
+		board.move(move);
+
+		// opponents turn
+		turn = TOGGLE_COLOR(turn);
+	}
+
+	return Draw;
+}
+
+double Match::elo(double & margin) const
+{
+	double n = wins + draws + losses, score, variance;
+
+	if(n == 0) {
+		margin = 0.0;
+		return 0.0;
+	}
+
+	score = (wins + 0.5 * draws) / n;
+	variance = (wins * (1.0 - score) * (1.0 - score)
+		+ draws * (0.5 - score) * (0.5 - score)
+		+ losses * score * score) / n;
+
+	// 95% confidence interval of the mean score mapped to elo
+	margin = 1.96 * sqrt(variance / n);
+	margin = (scoreToElo(score + margin) - scoreToElo(score - margin)) / 2.0;
+
+	return scoreToElo(score);
+}
+
+double Match::llr(void) const
+{
+	double n = wins + draws + losses, score, variance, s0, s1;
+
+	if(n == 0)
+		return 0.0;
+
+	score = (wins + 0.5 * draws) / n;
+	variance = (wins * (1.0 - score) * (1.0 - score)
+		+ draws * (0.5 - score) * (0.5 - score)
+		+ losses * score * score) / n;
+
+	if(variance <= 0.0)
+		return 0.0;
+
+	s0 = eloToScore(elo0);
+	s1 = eloToScore(elo1);
+
+	// normal approximation of the generalized SPRT
+	return n * (s1 - s0) * (2.0 * score - s0 - s1) / (2.0 * variance);
+}
@@ -0,0 +1,112 @@
+#ifndef MATCH_H_INCLUDED
+#define MATCH_H_INCLUDED
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+* Everything needed to construct one AIPlayer of a match.
+*/
+struct EngineConfig
+{
+	int search_depth;
+	int time;		// milliseconds per game, 0 to search search_depth plies
+	int increment;	// milliseconds added after each move
+};
+
+/*
+* Plays two AIPlayer configurations against each other in-process. Every
+* opening is played twice with colors reversed and games run in parallel.
+* Results are always counted from the point of view of the first engine.
+*/
+class Match
+{
+	public:
+
+		enum Result { Loss = 0, Draw = 1, Win = 2 };
+
+		Match(const EngineConfig & first, const EngineConfig & second);
+
+		/*
+		* Load opening positions, one FEN per line. Returns the number of
+		* openings read or -1 if the file could not be opened.
+		*/
+		int loadOpenings(const char * filename);
+
+		/*
+		* Use a small built-in opening set.
+		*/
+		void useDefaultOpenings(void);
+
+		/*
+		* Stop the match as soon as the sequential probability ratio test
+		* accepts either H0: elo = elo0 or H1: elo = elo1.
+		*/
+		void setSPRT(double elo0, double elo1, double alpha, double beta);
+
+		/*
+		* Games longer than this are adjudicated as draws.
+		*/
+		void setMaxPlies(int max_plies);
+
+		/*
+		* Seed of the match, the current time by default. The players of
+		* each game get seeds derived from it and the game index, so a
+		* match at fixed depths can be played again move by move.
+		*/
+		void setSeed(unsigned int seed);
+
+		/*
+		* Play up to games games on threads worker threads. Prints a
+		* progress line after every finished game.
+		*/
+		void run(int games, int threads);
+
+		/*
+		* Print final statistics.
+		*/
+		void printResult(void) const;
+
+		/*
+		* Play a single game from the given position, the players seeded
+		* with seed and seed + 1. Returns the result for white.
+		*/
+		static Result playGame(const EngineConfig & white,
+			const EngineConfig & black, const char * fen, int max_plies,
+			unsigned int seed);
+
+		/*
+		* Elo difference and the half width of its 95% confidence interval.
+		*/
+		double elo(double & margin) const;
+
+		/*
+		* Log-likelihood ratio of H1 versus H0 for the current results.
+		*/
+		double llr(void) const;
+
+	protected:
+
+		/*
+		* Loop of worker thread index of count
+		*/
+		void worker(int index, int count);
+
+		EngineConfig first, second;
+		std::vector<std::string> openings;
+		int max_plies;
+		unsigned int seed;
+
+		// sprt parameters
+		bool sprt;
+		double elo0, elo1, alpha, beta;
+
+		// shared state of the workers
+		std::mutex lock;
+		int next_game, total_games;
+		int wins, draws, losses;
+		bool stop;
+};
+
+#endif
@@ -0,0 +1,208 @@
+#ifdef PERF_COUNTERS
+
+#include <cstdio>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "perfcounters.h"
+
+static const char * phase_names[PerfPhases] = {
+	"search", "getMoves", "isVulnerable", "evaluateBoard"
+};
+
+static const char * event_names[PERF_EVENTS] = {
+	"cycles", "instructions", "L1d-misses", "LLC-misses", "branch-misses"
+};
+
+static const struct {
+	uint32_t type;
+	uint64_t config;
+} events[PERF_EVENTS] = {
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+		| (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+};
+
+/*
+* Counters are per thread, so the ponder thread and the match workers
+* measure only themselves. Each counter's page is mapped, so it is read
+* with rdpmc in user space and a scope costs no system call.
+*/
+struct PerfThread
+{
+	bool opened;
+	bool enabled;	// false if counters cannot be read in user space
+	int fds[PERF_EVENTS];
+	volatile struct perf_event_mmap_page * pages[PERF_EVENTS];	// NULL if not open
+	uint64_t totals[PerfPhases][PERF_EVENTS];
+	uint64_t calls[PerfPhases];
+};
+
+static thread_local PerfThread perf_thread;
+
+#if defined(__x86_64__) || defined(__i386__)
+
+static inline uint64_t rdpmc(uint32_t counter)
+{
+	uint32_t low, high;
+
+	__asm__ __volatile__("rdpmc" : "=a" (low), "=d" (high) : "c" (counter));
+	return ((uint64_t)high << 32) | low;
+}
+
+/*
+* Value of a counter from its mapped page. The kernel bumps lock while it
+* updates the page, so the read is repeated if it changed meanwhile. A
+* counter that is not on the PMU right now has its value in offset.
+*/
+static uint64_t readCounter(volatile struct perf_event_mmap_page * page)
+{
+	uint32_t lock, index;
+	int64_t count, pmc;
+	int width;
+
+	do {
+		lock = page->lock;
+		__asm__ __volatile__("" ::: "memory");
+
+		index = page->index;
+		count = page->offset;
+		if(page->cap_user_rdpmc && index != 0) {
+			width = page->pmc_width;
+			pmc = rdpmc(index - 1);
+			pmc <<= 64 - width;
+			pmc >>= 64 - width;
+			count += pmc;
+		}
+
+		__asm__ __volatile__("" ::: "memory");
+	} while(page->lock != lock);
+
+	return count;
+}
+
+#else
+
+// no rdpmc, perfOpen leaves the counters disabled
+static uint64_t readCounter(volatile struct perf_event_mmap_page *)
+{
+	return 0;
+}
+
+#endif
+
+/*
+* Open all counters of the calling thread as one pinned group, so they
+* count at the same time and stay on the PMU, and map their pages. Events
+* the CPU lacks stay at zero.
+*/
+static void perfOpen(PerfThread & t)
+{
+	struct perf_event_attr attr;
+	long page_size = sysconf(_SC_PAGESIZE);
+	void * page;
+	int leader = -1, i;
+
+	t.opened = true;
+	t.enabled = false;
+
+	for(i = 0; i < PERF_EVENTS; i++)
+	{
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = events[i].type;
+		attr.config = events[i].config;
+		attr.disabled = (i == 0);
+		attr.pinned = (i == 0);
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		t.pages[i] = NULL;
+		t.fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+		if(i == 0 && t.fds[0] < 0) {
+			fprintf(stderr, "perf counters not available\n");
+			return;
+		}
+		if(i == 0)
+			leader = t.fds[0];
+		if(t.fds[i] < 0)
+			continue;
+
+		page = mmap(NULL, page_size, PROT_READ, MAP_SHARED, t.fds[i], 0);
+		if(page != MAP_FAILED)
+			t.pages[i] = (volatile struct perf_event_mmap_page *)page;
+	}
+
+	ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+#if defined(__x86_64__) || defined(__i386__)
+	t.enabled = t.pages[0] != NULL && t.pages[0]->cap_user_rdpmc;
+#endif
+
+	if(!t.enabled)
+		fprintf(stderr, "perf counters cannot be read in user space (rdpmc)\n");
+}
+
+/*
+* Current values of all counters of the calling thread
+*/
+static void perfRead(PerfThread & t, uint64_t values[PERF_EVENTS])
+{
+	int i;
+
+	if(!t.opened)
+		perfOpen(t);
+
+	for(i = 0; i < PERF_EVENTS; i++)
+		values[i] = (t.enabled && t.pages[i]) ? readCounter(t.pages[i]) : 0;
+}
+
+PerfScope::PerfScope(int phase)
+ : phase(phase)
+{
+	perfRead(perf_thread, start);
+}
+
+PerfScope::~PerfScope()
+{
+	uint64_t end[PERF_EVENTS];
+	int i;
+
+	perfRead(perf_thread, end);
+
+	for(i = 0; i < PERF_EVENTS; i++)
+		perf_thread.totals[phase][i] += end[i] - start[i];
+	perf_thread.calls[phase]++;
+}
+
+void perfReset(void)
+{
+	memset(perf_thread.totals, 0, sizeof(perf_thread.totals));
+	memset(perf_thread.calls, 0, sizeof(perf_thread.calls));
+}
+
+void perfReport(void)
+{
+	int phase, i;
+
+	printf("%-14s %12s", "phase", "calls");
+	for(i = 0; i < PERF_EVENTS; i++)
+		printf(" %14s", event_names[i]);
+	printf("\n");
+
+	for(phase = 0; phase < PerfPhases; phase++)
+	{
+		printf("%-14s %12llu", phase_names[phase], (unsigned long long)perf_thread.calls[phase]);
+		for(i = 0; i < PERF_EVENTS; i++)
+			printf(" %14llu", (unsigned long long)perf_thread.totals[phase][i]);
+		printf("\n");
+	}
+}
+
+#endif
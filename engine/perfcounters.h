@@ -0,0 +1,58 @@
+#ifndef PERF_COUNTERS_H_INCLUDED
+#define PERF_COUNTERS_H_INCLUDED
+
+#include <stdint.h>
+
+/*
+* Parts of the search measured by the hardware counters. Phases nest, so a
+* phase includes the ones called from it.
+*/
+enum PerfPhase {
+	PerfSearch = 0,		// root searches, that is evalAlphaBeta
+	PerfGetMoves,
+	PerfIsVulnerable,
+	PerfEvaluate,
+	PerfPhases
+};
+
+#ifdef PERF_COUNTERS
+
+// cycles, instructions, L1 data misses, last level cache misses, branch misses
+#define PERF_EVENTS 5
+
+/*
+* Reads the counters of the calling thread when created and adds what
+* happened until it is destroyed to the totals of its phase.
+*/
+struct PerfScope
+{
+	PerfScope(int phase);
+	~PerfScope();
+
+	int phase;
+	uint64_t start[PERF_EVENTS];
+};
+
+/*
+* Clear the totals of the calling thread.
+*/
+void perfReset(void);
+
+/*
+* Print the totals of the calling thread per phase.
+*/
+void perfReport(void);
+
+#define PERF_SCOPE(phase) PerfScope perf_scope(phase)
+#define PERF_RESET() perfReset()
+#define PERF_REPORT() perfReport()
+
+#else
+
+#define PERF_SCOPE(phase)
+#define PERF_RESET()
+#define PERF_REPORT()
+
+#endif
+
+#endif
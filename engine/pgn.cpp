@@ -0,0 +1,600 @@
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include "pgn.h"
+
+using namespace std;
+
+// Bytes read from a PGN file at once
+#define PGN_BUFFER (1 << 16)
+
+// Longest token kept, longer ones are no moves anyway
+#define PGN_TOKEN 32
+
+static const char piece_letters[] = " PRNBQK";
+
+/*
+* Figure type of a piece letter of SAN, EMPTY for anything else
+*/
+static int pieceFromLetter(char c)
+{
+	switch(c)
+	{
+		case 'R': return ROOK;
+		case 'N': return KNIGHT;
+		case 'B': return BISHOP;
+		case 'Q': return QUEEN;
+		case 'K': return KING;
+		default:  return EMPTY;
+	}
+}
+
+/*
+* Legal moves of the piece on pos to square to, appended to found.
+*/
+static void getLegalMovesTo(ChessBoard & board, int pos, int to, list<Move> & found)
+{
+	list<Move> moves, nulls;
+	int figure = board.square[pos], color = IS_BLACK(figure);
+
+	switch(FIGURE(figure))
+	{
+		case PAWN:
+			board.getPawnMoves(figure, pos, moves, moves, nulls);
+			break;
+		case ROOK:
+			board.getRookMoves(figure, pos, moves, moves);
+			break;
+		case KNIGHT:
+			board.getKnightMoves(figure, pos, moves, moves);
+			break;
+		case BISHOP:
+			board.getBishopMoves(figure, pos, moves, moves);
+			break;
+		case QUEEN:
+			board.getQueenMoves(figure, pos, moves, moves);
+			break;
+		case KING:
+			board.getKingMoves(figure, pos, moves, moves);
+			break;
+		default:
+			return;
+	}
+
+	for(list<Move>::iterator it = moves.begin(); it != moves.end(); ++it)
+	{
+		if((*it).to != to)
+			continue;
+
+		board.move(*it);
+		if(!board.isVulnerable((color ? board.black_king_pos : board.white_king_pos), color))
+			found.push_back(*it);
+		board.undoMove(*it);
+	}
+}
+
+bool parseSAN(ChessBoard & board, int color, const char * san, Move & move)
+{
+	char buf[PGN_TOKEN];
+	int figure = PAWN, promotion = EMPTY, from_col = -1, from_row = -1, to, len, i = 0, pos;
+	list<Move> found;
+
+	// without check signs and annotations
+	for(len = 0; san[len] && !strchr("+#!?", san[len]) && len < PGN_TOKEN - 1; len++)
+		buf[len] = san[len];
+	buf[len] = '\0';
+
+	// castling moves the king two squares
+	if(strcmp(buf, "O-O") == 0 || strcmp(buf, "0-0") == 0) {
+		figure = KING;
+		from_col = 4;
+		to = color ? ChessBoard::G8 : ChessBoard::G1;
+	}
+	else if(strcmp(buf, "O-O-O") == 0 || strcmp(buf, "0-0-0") == 0) {
+		figure = KING;
+		from_col = 4;
+		to = color ? ChessBoard::C8 : ChessBoard::C1;
+	}
+	else
+	{
+		if(pieceFromLetter(buf[0]) != EMPTY)
+			figure = pieceFromLetter(buf[i++]);
+
+		// promotion piece at the end, "e8=Q" or "e8Q"
+		if(figure == PAWN && len >= 2 && pieceFromLetter(buf[len - 1]) != EMPTY) {
+			promotion = pieceFromLetter(buf[len - 1]);
+			len -= (buf[len - 2] == '=') ? 2 : 1;
+		}
+
+		// destination is the last square, origin file and rank may come
+		// before it
+		if(len - i < 2 || buf[len - 2] < 'a' || buf[len - 2] > 'h' || buf[len - 1] < '1' || buf[len - 1] > '8')
+			return false;
+		to = (buf[len - 1] - '1') * 8 + (buf[len - 2] - 'a');
+
+		for(len -= 2; i < len; i++)
+		{
+			if(buf[i] >= 'a' && buf[i] <= 'h')
+				from_col = buf[i] - 'a';
+			else if(buf[i] >= '1' && buf[i] <= '8')
+				from_row = buf[i] - '1';
+			else if(buf[i] != 'x' && buf[i] != ':' && buf[i] != '-')
+				return false;
+		}
+
+		// pawns without a capture stay on their file
+		if(figure == PAWN && from_col < 0)
+			from_col = to % 8;
+	}
+
+	for(pos = 0; pos < 64; pos++)
+	{
+		if(FIGURE(board.square[pos]) != figure || IS_BLACK(board.square[pos]) != color)
+			continue;
+		if((from_col >= 0 && pos % 8 != from_col) || (from_row >= 0 && pos / 8 != from_row))
+			continue;
+
+		getLegalMovesTo(board, pos, to, found);
+	}
+
+	// a pawn reaching the last rank comes once per promotion piece
+	for(list<Move>::iterator it = found.begin(); it != found.end(); )
+	{
+		if((*it).promotion != promotion)
+			it = found.erase(it);
+		else
+			++it;
+	}
+
+	if(found.size() != 1)
+		return false;
+
+	move = found.front();
+	return true;
+}
+
+bool playSAN(ChessBoard & board, int & color, const char * san, Move * played)
+{
+	Move move, clear;
+	int pos, end, figure;
+
+	if(!parseSAN(board, color, san, move))
+		return false;
+
+	// maintenance moves: own pawns cannot be taken en passant any more, the
+	// only ones marked stand where their double step ended
+	pos = color ? ChessBoard::A5 : ChessBoard::A4;
+	for(end = pos + 8; pos < end; pos++)
+	{
+		figure = board.square[pos];
+		if(FIGURE(figure) == PAWN && IS_BLACK(figure) == color && IS_PASSANT(figure)) {
+			clear.figure = CLEAR_PASSANT(figure);
+			clear.from = pos;
+			clear.to = pos;
+			clear.capture = figure;
+			clear.promotion = EMPTY;
+			board.move(clear);
+
+			if(move.from == pos)
+				move.figure = CLEAR_PASSANT(move.figure);
+		}
+	}
+
+	board.move(move);
+	color = TOGGLE_COLOR(color);
+
+	if(played)
+		*played = move;
+
+	return true;
+}
+
+void toSAN(ChessBoard & board, int color, const Move & move, char * buf)
+{
+	int figure = FIGURE(move.figure), opponent = TOGGLE_COLOR(color), i = 0, pos;
+	bool ambiguous = false, same_col = false, same_row = false;
+	list<Move> found;
+
+	if(figure == KING && move.from % 8 == 4 && move.to % 8 == 6 && move.from / 8 == move.to / 8) {
+		strcpy(buf, "O-O");
+		i = 3;
+	}
+	else if(figure == KING && move.from % 8 == 4 && move.to % 8 == 2 && move.from / 8 == move.to / 8) {
+		strcpy(buf, "O-O-O");
+		i = 5;
+	}
+	else
+	{
+		if(figure == PAWN) {
+			// captures, en passant too, change the file
+			if(move.from % 8 != move.to % 8) {
+				buf[i++] = 'a' + move.from % 8;
+				buf[i++] = 'x';
+			}
+		}
+		else {
+			buf[i++] = piece_letters[figure];
+
+			// other pieces of the same kind that can go there
+			for(pos = 0; pos < 64; pos++)
+			{
+				if(pos == move.from || (board.square[pos] & 0x17) != (move.figure & 0x17))
+					continue;
+
+				found.clear();
+				getLegalMovesTo(board, pos, move.to, found);
+				if(found.empty())
+					continue;
+
+				ambiguous = true;
+				same_col |= (pos % 8 == move.from % 8);
+				same_row |= (pos / 8 == move.from / 8);
+			}
+
+			// the file if it tells them apart, else the rank, else both
+			if(ambiguous && (!same_col || same_row))
+				buf[i++] = 'a' + move.from % 8;
+			if(ambiguous && same_col)
+				buf[i++] = '1' + move.from / 8;
+
+			if(move.capture != EMPTY)
+				buf[i++] = 'x';
+		}
+
+		buf[i++] = 'a' + move.to % 8;
+		buf[i++] = '1' + move.to / 8;
+
+		if(move.promotion != EMPTY) {
+			buf[i++] = '=';
+			buf[i++] = piece_letters[move.promotion];
+		}
+	}
+
+	// check or mate
+	board.move(move);
+	if(board.isVulnerable((opponent ? board.black_king_pos : board.white_king_pos), opponent))
+		buf[i++] = (board.getPlayerStatus(opponent) == ChessPlayer::Checkmate) ? '#' : '+';
+	board.undoMove(move);
+
+	buf[i] = '\0';
+}
+
+void PGNGame::clear(void)
+{
+	result.clear();
+	tags.clear();
+	text.clear();
+	moves.clear();
+}
+
+void PGNGame::clearMoves(void)
+{
+	text.clear();
+	moves.clear();
+}
+
+const char * PGNGame::getTag(const char * name) const
+{
+	for(size_t i = 0; i < tags.size(); i++)
+		if(tags[i].first == name)
+			return tags[i].second.c_str();
+
+	return NULL;
+}
+
+void PGNGame::setTag(const char * name, const char * value)
+{
+	for(size_t i = 0; i < tags.size(); i++) {
+		if(tags[i].first == name) {
+			tags[i].second = value;
+			return;
+		}
+	}
+
+	tags.push_back(make_pair(string(name), string(value)));
+}
+
+int PGNGame::getMoveCount(void) const
+{
+	return moves.size();
+}
+
+const char * PGNGame::getMove(int i) const
+{
+	return &text[moves[i]];
+}
+
+void PGNGame::addMove(const char * san)
+{
+	moves.push_back(text.size());
+	text.insert(text.end(), san, san + strlen(san) + 1);
+}
+
+bool PGNGame::getStartPosition(ChessBoard & board, int & color) const
+{
+	const char * fen = getTag("FEN");
+
+	if(fen)
+		return board.initFEN(fen, color);
+
+	board.initDefaultSetup();
+	color = WHITE;
+
+	return true;
+}
+
+PGNReader::PGNReader()
+ : file(NULL),
+   buffer(new char[PGN_BUFFER]),
+   pos(0),
+   length(0)
+{}
+
+PGNReader::~PGNReader()
+{
+	close();
+	delete[] buffer;
+}
+
+bool PGNReader::open(const char * filename)
+{
+	close();
+
+	if(strcmp(filename, "-") == 0)
+		file = stdin;
+	else
+		file = fopen(filename, "r");
+
+	return file != NULL;
+}
+
+void PGNReader::close(void)
+{
+	if(file && file != stdin)
+		fclose(file);
+
+	file = NULL;
+	pos = length = 0;
+}
+
+bool PGNReader::fill(void)
+{
+	if(file == NULL)
+		return false;
+
+	length = fread(buffer, 1, PGN_BUFFER, file);
+	pos = 0;
+
+	return length > 0;
+}
+
+void PGNReader::skipComment(void)
+{
+	int c;
+
+	while((c = get()) != EOF && c != '}')
+		;
+}
+
+void PGNReader::skipVariation(void)
+{
+	int c, depth = 0;
+
+	while((c = get()) != EOF)
+	{
+		if(c == '(')
+			depth++;
+		else if(c == ')' && --depth == 0)
+			return;
+		else if(c == '{')
+			skipComment();
+	}
+}
+
+void PGNReader::skipLine(void)
+{
+	int c;
+
+	while((c = get()) != EOF && c != '\n')
+		;
+}
+
+bool PGNReader::readTag(PGNGame & game)
+{
+	int c;
+
+	token.clear();
+	value.clear();
+
+	// [Name "Value"]
+	get();
+	while((c = peek()) != EOF && isspace(c))
+		get();
+	while((c = peek()) != EOF && !isspace(c) && c != '"' && c != ']')
+		token += get();
+	while((c = peek()) != EOF && c != '"' && c != ']' && c != '\n')
+		get();
+
+	if(get() != '"') {
+		skipLine();
+		return false;
+	}
+
+	while((c = get()) != EOF && c != '"' && c != '\n')
+	{
+		if(c == '\\')
+			c = get();
+		value += c;
+	}
+
+	while(c != EOF && c != ']' && c != '\n')
+		c = get();
+
+	game.setTag(token.c_str(), value.c_str());
+	return true;
+}
+
+bool PGNReader::readGame(PGNGame & game)
+{
+	char word[PGN_TOKEN];
+	bool found = false;
+	int c, len, i;
+
+	game.clear();
+
+	while((c = peek()) != EOF)
+	{
+		if(isspace(c)) {
+			get();
+			continue;
+		}
+
+		switch(c)
+		{
+			case '[':
+				// tags after moves belong to the next game, its result was
+				// missing
+				if(game.getMoveCount() > 0)
+					return true;
+				found |= readTag(game);
+				continue;
+			case '{':
+				skipComment();
+				continue;
+			case ';':
+			case '%':
+				skipLine();
+				continue;
+			case '(':
+				skipVariation();
+				continue;
+			case '$':
+				get();
+				while((c = peek()) != EOF && isdigit(c))
+					get();
+				continue;
+			default:
+				break;
+		}
+
+		// a move, move number or result
+		for(len = 0; (c = peek()) != EOF && !isspace(c) && !strchr("{}();[", c); len++)
+		{
+			c = get();
+			if(len < PGN_TOKEN - 1)
+				word[len] = c;
+		}
+		if(len > PGN_TOKEN - 1)
+			len = PGN_TOKEN - 1;
+		word[len] = '\0';
+
+		if(len == 0) {
+			// a stray ')' or '}'
+			get();
+			continue;
+		}
+
+		found = true;
+
+		if(strcmp(word, "1-0") == 0 || strcmp(word, "0-1") == 0
+			|| strcmp(word, "1/2-1/2") == 0 || strcmp(word, "*") == 0) {
+			game.result = word;
+			return true;
+		}
+
+		// move numbers, "12." or "12...", may stick to the move
+		for(i = 0; isdigit(word[i]); i++)
+			;
+		if(word[i] == '.') {
+			while(word[i] == '.')
+				i++;
+		}
+		else {
+			i = 0;
+		}
+
+		// digits left are a move number without '.', unless castling with
+		// zeros like "0-0" or "12.0-0-0"
+		if(word[i] != '\0' && (!isdigit(word[i]) || strncmp(word + i, "0-0", 3) == 0))
+			game.addMove(word + i);
+	}
+
+	return found;
+}
+
+void writePGN(FILE * file, const PGNGame & game)
+{
+	const char * fen = game.getTag("FEN"), * result, * p;
+	const char * roster[] = { "Event", "Site", "Date", "Round", "White", "Black", "Result" };
+	char number[16];
+	int color = WHITE, move_number = 1, column = 0, len, i;
+
+	result = game.result.empty() ? "*" : game.result.c_str();
+
+	// the seven tag roster comes first and is always there
+	for(i = 0; i < 7; i++)
+	{
+		if(strcmp(roster[i], "Result") == 0)
+			p = result;
+		else if((p = game.getTag(roster[i])) == NULL)
+			p = "?";
+
+		fprintf(file, "[%s \"", roster[i]);
+		for(; *p; p++)
+			fprintf(file, (*p == '"' || *p == '\\') ? "\\%c" : "%c", *p);
+		fprintf(file, "\"]\n");
+	}
+
+	for(i = 0; i < (int)game.tags.size(); i++)
+	{
+		const string & name = game.tags[i].first;
+
+		if(name == "Event" || name == "Site" || name == "Date" || name == "Round"
+			|| name == "White" || name == "Black" || name == "Result")
+			continue;
+
+		fprintf(file, "[%s \"", name.c_str());
+		for(p = game.tags[i].second.c_str(); *p; p++)
+			fprintf(file, (*p == '"' || *p == '\\') ? "\\%c" : "%c", *p);
+		fprintf(file, "\"]\n");
+	}
+
+	fprintf(file, "\n");
+
+	// side to move and move number of the start position
+	if(fen && (p = strchr(fen, ' ')) != NULL) {
+		color = (p[1] == 'b') ? BLACK : WHITE;
+		if((p = strrchr(fen, ' ')) != NULL && atoi(p + 1) > 0)
+			move_number = atoi(p + 1);
+	}
+
+	for(i = 0; i < game.getMoveCount(); i++)
+	{
+		number[0] = '\0';
+		if(color == WHITE)
+			snprintf(number, sizeof(number), "%d. ", move_number);
+		else if(i == 0)
+			snprintf(number, sizeof(number), "%d... ", move_number);
+
+		len = strlen(number) + strlen(game.getMove(i));
+		if(column > 0 && column + 1 + len > 80) {
+			fprintf(file, "\n");
+			column = 0;
+		}
+
+		column += fprintf(file, "%s%s%s", column > 0 ? " " : "", number, game.getMove(i));
+
+		if(color == BLACK)
+			move_number++;
+		color = TOGGLE_COLOR(color);
+	}
+
+	if(column > 0 && column + 1 + (int)strlen(result) > 80) {
+		fprintf(file, "\n");
+		column = 0;
+	}
+
+	fprintf(file, "%s%s\n\n", column > 0 ? " " : "", result);
+}
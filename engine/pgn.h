@@ -0,0 +1,151 @@
+#ifndef PGN_H_INCLUDED
+#define PGN_H_INCLUDED
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+#include "chessboard.h"
+
+// Longest SAN of a move including check sign, "exd8=Q+" or "Qa1xb2#"
+#define SAN_LENGTH 8
+
+/*
+* Finds the move written in Standard Algebraic Notation among the legal
+* moves of color, like "Nbd7", "exd6", "e8=Q+" or "O-O". Check signs and
+* annotations like "!?" are ignored. Returns false if no legal move or
+* more than one fits.
+*/
+bool parseSAN(ChessBoard & board, int color, const char * san, Move & move);
+
+/*
+* Same as parseSAN, and plays the move the way the game loop does, with
+* its maintenance moves. color changes to the side to move next.
+*/
+bool playSAN(ChessBoard & board, int & color, const char * san, Move * played = NULL);
+
+/*
+* Writes move, a legal move of color, in SAN to buf, which needs room for
+* SAN_LENGTH chars.
+*/
+void toSAN(ChessBoard & board, int color, const Move & move, char * buf);
+
+/*
+* One game of a PGN file: its tag pairs and the moves as SAN strings. The
+* buffers are kept when a game is cleared, so reading many games into the
+* same object allocates only for their tags.
+*/
+class PGNGame
+{
+	public:
+
+		void clear(void);
+
+		/*
+		* Drop the moves only, keeping tags and result
+		*/
+		void clearMoves(void);
+
+		/*
+		* Value of a tag or NULL if the game has none
+		*/
+		const char * getTag(const char * name) const;
+
+		void setTag(const char * name, const char * value);
+
+		int getMoveCount(void) const;
+		const char * getMove(int i) const;
+
+		void addMove(const char * san);
+
+		/*
+		* Board and side to move the game starts from: the FEN tag or the
+		* initial setup. Returns false if the FEN is malformed.
+		*/
+		bool getStartPosition(ChessBoard & board, int & color) const;
+
+		// "1-0", "0-1", "1/2-1/2" or "*"
+		std::string result;
+
+	protected:
+
+		friend void writePGN(FILE * file, const PGNGame & game);
+
+		std::vector< std::pair<std::string, std::string> > tags;
+
+		// the moves, each terminated by 0, and where each starts
+		std::vector<char> text;
+		std::vector<uint32_t> moves;
+};
+
+/*
+* Reads the games of a PGN file one after the other through a buffer of
+* its own. Comments, variations, move numbers and NAGs are skipped.
+*/
+class PGNReader
+{
+	public:
+
+		PGNReader();
+		~PGNReader();
+
+		PGNReader(const PGNReader &) = delete;
+		PGNReader & operator=(const PGNReader &) = delete;
+
+		/*
+		* Open a file, "-" for stdin. Returns false if it cannot be read.
+		*/
+		bool open(const char * filename);
+
+		void close(void);
+
+		/*
+		* Read the next game. Returns false at the end of the file.
+		*/
+		bool readGame(PGNGame & game);
+
+	protected:
+
+		/*
+		* Next character without consuming it, EOF at the end
+		*/
+		int peek(void)
+		{
+			if(pos == length && !fill())
+				return EOF;
+			return buffer[pos];
+		}
+
+		int get(void)
+		{
+			if(pos == length && !fill())
+				return EOF;
+			return buffer[pos++];
+		}
+
+		bool fill(void);
+
+		/*
+		* Skip a {comment}, a (variation) with everything nested in it or
+		* the rest of the line.
+		*/
+		void skipComment(void);
+		void skipVariation(void);
+		void skipLine(void);
+
+		bool readTag(PGNGame & game);
+
+		FILE * file;
+		char * buffer;
+		size_t pos, length;
+		std::string token, value;
+};
+
+/*
+* Writes a game in export format: the tags, then the moves with move
+* numbers in lines of at most 80 chars, then the result.
+*/
+void writePGN(FILE * file, const PGNGame & game);
+
+#endif
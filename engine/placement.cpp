@@ -0,0 +1,79 @@
+#include <new>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "placement.h"
+
+// Size of a huge page on x86-64 and most other 64 bit systems
+#define HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024)
+
+/*
+* Size rounded up to whole huge pages
+*/
+static size_t roundSize(size_t size)
+{
+	return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+void * allocLarge(size_t size)
+{
+	size_t length = roundSize(size);
+	uintptr_t start, aligned;
+	void * p;
+
+	// explicit huge pages, if the administrator reserved some
+	p = mmap(NULL, length, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if(p != MAP_FAILED)
+		return p;
+
+	// transparent huge pages need 2MB alignment, so map one page more and
+	// give back what is before and after the aligned part
+	p = mmap(NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(p == MAP_FAILED)
+		throw std::bad_alloc();
+
+	start = (uintptr_t)p;
+	aligned = (start + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+	if(aligned > start)
+		munmap(p, aligned - start);
+	munmap((void*)(aligned + length), start + HUGE_PAGE_SIZE - aligned);
+
+	madvise((void*)aligned, length, MADV_HUGEPAGE);
+
+	return (void*)aligned;
+}
+
+void freeLarge(void * p, size_t size)
+{
+	munmap(p, roundSize(size));
+}
+
+bool bindThread(int index, int count)
+{
+	cpu_set_t available, cpu;
+	int cpus, target, i, n;
+
+	if(sched_getaffinity(0, sizeof(available), &available) != 0)
+		return false;
+
+	if((cpus = CPU_COUNT(&available)) < 1 || count < 1)
+		return false;
+
+	// spread evenly, wrap around if there are more threads than CPUs
+	target = (count <= cpus) ? index * cpus / count : index % cpus;
+
+	CPU_ZERO(&cpu);
+	for(i = 0, n = 0; i < CPU_SETSIZE; i++)
+	{
+		if(CPU_ISSET(i, &available) && n++ == target) {
+			CPU_SET(i, &cpu);
+			break;
+		}
+	}
+
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpu), &cpu) == 0;
+}
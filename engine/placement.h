@@ -0,0 +1,28 @@
+#ifndef PLACEMENT_H_INCLUDED
+#define PLACEMENT_H_INCLUDED
+
+#include <stddef.h>
+
+/*
+* Allocate a large table, backed by 2MB pages where the system has them:
+* explicit huge pages first, then transparent huge pages on 2MB aligned
+* memory, then normal pages. The memory is not touched, so its pages are
+* placed on the NUMA node of the thread that clears it first. Throws
+* std::bad_alloc like new.
+*/
+void * allocLarge(size_t size);
+
+/*
+* Release memory of allocLarge, size as given there.
+*/
+void freeLarge(void * p, size_t size);
+
+/*
+* Bind the calling thread, number index of count threads, to one CPU. The
+* threads are spread evenly over all CPUs, and so over all NUMA nodes, and
+* what they allocate and touch first stays local to them. Returns false if
+* the system does not allow it.
+*/
+bool bindThread(int index, int count);
+
+#endif
@@ -1,25 +1,50 @@
 //#include <mcheck.h>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <list>
+#include <vector>
 #include "chessboard.h"
 #include "humanplayer.h"
 #include "aiplayer.h"
+#include "bench.h"
 
 using namespace std;
 
-int main(void) {
+int main(int argc, char ** argv) {
 
 	ChessBoard board;
 	list<Move> regulars, nulls;
-	int turn = WHITE;
+	vector<AnalysisLine> lines;
+	const char * shared_table = NULL;
+	int turn = WHITE, multipv = 0, i;
 	Move move;
 	bool found;
+	char buf[6];
+
+	// reproducible search of fixed positions: bench [depth [nodes]]
+	if(argc > 1 && strcmp(argv[1], "bench") == 0) {
+		bench((argc > 2) ? atoi(argv[2]) : 4, (argc > 3) ? strtoull(argv[3], NULL, 10) : 0);
+		return 0;
+	}
+
+	for(i = 1; i + 1 < argc; i += 2)
+	{
+		// show the best lines of the computer with -multipv N
+		if(strcmp(argv[i], "-multipv") == 0)
+			multipv = atoi(argv[i + 1]);
+
+		// share its transposition table with -sharedhash NAME
+		else if(strcmp(argv[i], "-sharedhash") == 0)
+			shared_table = argv[i + 1];
+	}
 
 	// Initialize players
-	AIPlayer black(BLACK, 3);
+	AIPlayer black(BLACK, 3, shared_table);
 	HumanPlayer white(WHITE);
 
+	black.setMultiPV(multipv);
+
 	// setup board
 	board.initDefaultSetup();
 
@@ -27,15 +52,31 @@ int main(void) {
 		// show board
 		board.print();
 
+		// threefold repetition or fifty-move rule
+		if(board.getPlayerStatus(turn) == ChessPlayer::Draw)
+			break;
+
 		// query player's choice
 		if(turn)
-			found = black.getMove(board, move);
+			found = black.getMove(board, move, lines);
 		else
 			found = white.getMove(board, move);
 
 		if(!found)
 			break;
 
+		// the computer's alternatives or the line it expects
+		if(turn) {
+			for(unsigned i = 0; i < lines.size(); i++) {
+				printf("   %u. (%d)", i + 1, lines[i].score);
+				for(unsigned j = 0; j < lines[i].pv.size(); j++) {
+					lines[i].pv[j].toString(buf);
+					printf(" %s", buf);
+				}
+				printf("\n");
+			}
+		}
+
 		// if player has a move get all moves
 		regulars.clear();
 		nulls.clear();
@@ -49,6 +90,10 @@ int main(void) {
 		board.move(move);
 		move.print();
 
+		// think about the expected reply while the human ponders
+		if(turn)
+			black.startPondering(board);
+
 		// opponents turn
 		turn = TOGGLE_COLOR(turn);
 	}
@@ -63,5 +108,10 @@ int main(void) {
 		case ChessPlayer::Stalemate:
 			printf("Stalemate\n");
 			break;
+		case ChessPlayer::Draw:
+			printf("Draw\n");
+			break;
+		default:
+			break;
 	}
 }
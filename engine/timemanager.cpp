@@ -0,0 +1,80 @@
+#include <algorithm>
+#include "timemanager.h"
+
+using namespace std;
+
+TimeManager::TimeManager()
+{
+	start(0, 0, 0);
+}
+
+void TimeManager::start(int remaining, int increment, int moves_to_go)
+{
+	int left, moves;
+
+	start_time = chrono::steady_clock::now();
+
+	left = max(remaining - TIME_OVERHEAD, 1);
+	moves = (moves_to_go > 0) ? min(moves_to_go, TIME_MOVES_TO_GO) : TIME_MOVES_TO_GO;
+
+	// an even share of what is left plus most of the increment, at most a
+	// few times that when the search asks for more, but never so much that
+	// the following moves starve
+	optimum = left / moves + increment * 3 / 4;
+	if(moves == 1)
+		maximum = left;
+	else
+		maximum = min(optimum * 3, left / 4);
+	optimum = min(optimum, maximum);
+
+	scale = 1.0;
+	iterations = 0;
+	last_move = 0;
+	last_score = 0;
+	stable = 0;
+}
+
+bool TimeManager::iterationDone(uint16_t best_move, int score)
+{
+	double target;
+
+	if(iterations++ > 0)
+	{
+		// the search changed its mind, there is more to find
+		if(best_move != last_move) {
+			scale *= 1.5;
+			stable = 0;
+		}
+		else
+			stable++;
+
+		// trouble ahead, look for a way out
+		if(score < last_score - TIME_SCORE_DROP)
+			scale *= 1.25;
+	}
+
+	last_move = best_move;
+	last_score = score;
+
+	target = optimum * scale;
+
+	// one move clearly dominates
+	if(stable >= 3)
+		target /= 2;
+
+	target = min(target, (double)maximum);
+
+	// the next iteration takes longer than all before it together, so it
+	// cannot finish in what is left
+	return elapsed() >= target / 2;
+}
+
+bool TimeManager::isTimeUp(void) const
+{
+	return elapsed() >= maximum;
+}
+
+int TimeManager::elapsed(void) const
+{
+	return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time).count();
+}
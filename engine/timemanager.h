@@ -0,0 +1,67 @@
+#ifndef TIME_MANAGER_H_INCLUDED
+#define TIME_MANAGER_H_INCLUDED
+
+#include <chrono>
+#include <stdint.h>
+
+// Milliseconds kept back for passing the move on
+#define TIME_OVERHEAD 20
+
+// Moves the rest of the game is assumed to last if the clock does not say
+#define TIME_MOVES_TO_GO 30
+
+// Score loss between iterations that makes the search take more time
+#define TIME_SCORE_DROP 30
+
+/*
+* Decides how long to think on a move with a game clock. The search asks it
+* after every finished iteration whether to go on, and polls it in between
+* for the hard limit.
+*/
+class TimeManager
+{
+	public:
+
+		TimeManager();
+
+		/*
+		* Start thinking on a move. Remaining time and increment are in
+		* milliseconds, moves_to_go is the number of moves until the next
+		* time control, 0 for the rest of the game.
+		*/
+		void start(int remaining, int increment, int moves_to_go);
+
+		/*
+		* Called with best move and score of each finished iteration. Returns
+		* true if the next iteration should not be started. Changes of the
+		* best move and dropping scores extend the time for the move, a best
+		* move that stays the same shortens it.
+		*/
+		bool iterationDone(uint16_t best_move, int score);
+
+		/*
+		* True once the hard limit for the move is reached
+		*/
+		bool isTimeUp(void) const;
+
+		/*
+		* Milliseconds since start
+		*/
+		int elapsed(void) const;
+
+	protected:
+
+		std::chrono::steady_clock::time_point start_time;
+
+		int optimum;	// time for a move without surprises
+		int maximum;	// never think longer than this
+		double scale;	// optimum stretched by instability
+
+		// results of the last iteration
+		int iterations;
+		uint16_t last_move;
+		int last_score;
+		int stable;		// iterations without a change of the best move
+};
+
+#endif
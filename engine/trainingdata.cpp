@@ -0,0 +1,59 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <glob.h>
+#include "trainingdata.h"
+
+using namespace std;
+
+static_assert(sizeof(TrainingRecord) == 40, "TrainingRecord has to fit into 40 bytes");
+
+string shardName(const char * prefix, int index)
+{
+	char name[32];
+
+	snprintf(name, sizeof(name), "-%05d.bin", index);
+	return string(prefix) + name;
+}
+
+bool writeShard(const char * prefix, int index, const TrainingRecord * records,
+	size_t count)
+{
+	string name = shardName(prefix, index), tmp = name + ".tmp";
+	FILE * file;
+	bool ok;
+
+	if((file = fopen(tmp.c_str(), "wb")) == NULL)
+		return false;
+
+	ok = fwrite(records, sizeof(TrainingRecord), count, file) == count;
+	ok = (fclose(file) == 0) && ok;
+
+	if(!ok || rename(tmp.c_str(), name.c_str()) != 0) {
+		remove(tmp.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+vector<int> listShards(const char * prefix)
+{
+	string pattern = string(prefix) + "-[0-9]*.bin";
+	vector<int> indices;
+	glob_t found;
+	size_t i;
+
+	if(glob(pattern.c_str(), 0, NULL, &found) != 0)
+		return indices;
+
+	// the index sits between the last '-' and ".bin"
+	for(i = 0; i < found.gl_pathc; i++)
+		indices.push_back(atoi(strrchr(found.gl_pathv[i], '-') + 1));
+
+	globfree(&found);
+	sort(indices.begin(), indices.end());
+
+	return indices;
+}
@@ -0,0 +1,43 @@
+#ifndef TRAINING_DATA_H_INCLUDED
+#define TRAINING_DATA_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+#include <list>
+#include <string>
+#include <vector>
+#include "chessboard.h"
+
+/*
+* One position of a training data set with what the search and the game
+* made of it. Score and result are seen from the side to move.
+*/
+struct TrainingRecord
+{
+	PackedBoard board;
+	int16_t score;		// search score
+	uint16_t move;		// best move found, Move::pack()
+	uint16_t ply;		// plies since the start of the game
+	uint8_t result;		// 0 lost, 1 drawn, 2 won
+	uint8_t reserved;	// zero
+};
+
+/*
+* File name of shard index of a data set, PREFIX-00042.bin
+*/
+std::string shardName(const char * prefix, int index);
+
+/*
+* Write a complete shard. It is written under a temporary name and renamed
+* at the end, so an interrupted run never leaves a partial shard behind.
+* Returns false if the file could not be written.
+*/
+bool writeShard(const char * prefix, int index, const TrainingRecord * records,
+	size_t count);
+
+/*
+* Indices of the shards of a data set found on disk, in ascending order.
+*/
+std::vector<int> listShards(const char * prefix);
+
+#endif
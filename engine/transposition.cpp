@@ -0,0 +1,205 @@
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "placement.h"
+#include "transposition.h"
+
+// Layout of the data word
+#define DATA_MOVE(x)  ((uint16_t)(x))
+#define DATA_DEPTH(x) ((int)(int8_t)((x) >> 16))
+#define DATA_BOUND(x) ((int)(((x) >> 24) & 0x03))
+#define DATA_SCORE(x) ((int)(int32_t)((x) >> 32))
+
+// Where hugetlbfs is usually mounted
+#define HUGEPAGE_DIR "/dev/hugepages"
+
+// Waits of 10 ms for the creator of a segment to give it its size
+#define SEGMENT_WAITS 100
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+	"slots in shared memory need lock free 64 bit atomics");
+
+/*
+* Maps a file of exactly size bytes, creating it if needed. New files are
+* zero filled, which is an empty table. Returns MAP_FAILED on errors.
+*/
+static void * mapSegment(const char * path, bool posix, size_t size)
+{
+	void * p = MAP_FAILED;
+	struct stat st;
+	bool created = true;
+	int fd, waits;
+
+	fd = posix ? shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0600)
+		: open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+	if(fd < 0) {
+		created = false;
+		fd = posix ? shm_open(path, O_RDWR, 0600) : open(path, O_RDWR);
+	}
+
+	if(fd < 0)
+		return MAP_FAILED;
+
+	// a file just created by another process is empty until it is given
+	// its size
+	for(waits = 0; !created && waits < SEGMENT_WAITS; waits++)
+	{
+		if(fstat(fd, &st) != 0 || st.st_size != 0)
+			break;
+		usleep(10000);
+	}
+
+	// a table of another size cannot be shared
+	if((!created || ftruncate(fd, size) == 0)
+		&& fstat(fd, &st) == 0 && (size_t)st.st_size == size)
+	{
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+
+	close(fd);
+
+	if(p == MAP_FAILED && created) {
+		if(posix)
+			shm_unlink(path);
+		else
+			unlink(path);
+	}
+
+	return p;
+}
+
+TranspositionTable::TranspositionTable(unsigned long entries)
+{
+	unsigned long size = roundEntries(entries);
+
+	slots = (Slot*)allocLarge(size * sizeof(Slot));
+	mask = size - 1;
+	mapped = 0;
+
+	clear();
+}
+
+TranspositionTable::TranspositionTable(unsigned long entries, const char * name)
+{
+	unsigned long size = roundEntries(entries);
+	void * p = MAP_FAILED;
+	char path[256];
+
+	mask = size - 1;
+	mapped = size * sizeof(Slot);
+
+	if(name)
+	{
+		// hugetlbfs maps files with huge pages only
+		snprintf(path, sizeof(path), HUGEPAGE_DIR "/%s", name + (name[0] == '/'));
+		p = mapSegment(path, false, mapped);
+
+		// a POSIX segment otherwise, where huge pages are a wish
+		if(p == MAP_FAILED) {
+			snprintf(path, sizeof(path), "/%s", name + (name[0] == '/'));
+			if((p = mapSegment(path, true, mapped)) != MAP_FAILED)
+				madvise(p, mapped, MADV_HUGEPAGE);
+		}
+
+		if(p == MAP_FAILED)
+			fprintf(stderr, "Could not share transposition table %s, using a private one\n", name);
+	}
+
+	if(p != MAP_FAILED) {
+		slots = (Slot*)p;
+	}
+	else {
+		slots = (Slot*)allocLarge(size * sizeof(Slot));
+		mapped = 0;
+		clear();
+	}
+}
+
+TranspositionTable::~TranspositionTable()
+{
+	if(mapped)
+		munmap((void*)slots, mapped);
+	else
+		freeLarge((void*)slots, sizeof(Slot) * (mask + 1));
+}
+
+unsigned long TranspositionTable::roundEntries(unsigned long entries)
+{
+	unsigned long size = 1;
+
+	while((size << 1) <= entries)
+		size <<= 1;
+
+	return size;
+}
+
+bool TranspositionTable::probe(uint64_t key, TTEntry & entry) const
+{
+	const Slot & slot = slots[key & mask];
+	uint64_t data = slot.data.load(std::memory_order_relaxed);
+	uint64_t check = slot.check.load(std::memory_order_relaxed);
+
+	// empty, another position or torn by a concurrent store
+	if((check ^ data) != key || DATA_BOUND(data) == None)
+		return false;
+
+	entry.move = DATA_MOVE(data);
+	entry.depth = DATA_DEPTH(data);
+	entry.bound = DATA_BOUND(data);
+	entry.score = DATA_SCORE(data);
+
+	return true;
+}
+
+void TranspositionTable::store(uint64_t key, int depth, int score, int bound, uint16_t move)
+{
+	Slot & slot = slots[key & mask];
+	uint64_t data = slot.data.load(std::memory_order_relaxed);
+	uint64_t check = slot.check.load(std::memory_order_relaxed);
+
+	if((check ^ data) == key && DATA_BOUND(data) != None)
+	{
+		// keep deeper results of the same position
+		if(DATA_DEPTH(data) > depth && bound != Exact)
+			return;
+
+		// keep the old best move if we have none
+		if(move == 0)
+			move = DATA_MOVE(data);
+	}
+
+	data = (uint64_t)move
+		| ((uint64_t)(uint8_t)depth << 16)
+		| ((uint64_t)bound << 24)
+		| ((uint64_t)(uint32_t)score << 32);
+
+	slot.data.store(data, std::memory_order_relaxed);
+	slot.check.store(key ^ data, std::memory_order_relaxed);
+}
+
+void TranspositionTable::clear(void)
+{
+	for(uint64_t i = 0; i <= mask; i++) {
+		slots[i].check.store(0, std::memory_order_relaxed);
+		slots[i].data.store(0, std::memory_order_relaxed);
+	}
+}
+
+bool TranspositionTable::isShared(void) const
+{
+	return mapped != 0;
+}
+
+void TranspositionTable::remove(const char * name)
+{
+	char path[256];
+
+	snprintf(path, sizeof(path), HUGEPAGE_DIR "/%s", name + (name[0] == '/'));
+	unlink(path);
+
+	snprintf(path, sizeof(path), "/%s", name + (name[0] == '/'));
+	shm_unlink(path);
+}
@@ -0,0 +1,99 @@
+#ifndef TRANSPOSITION_H_INCLUDED
+#define TRANSPOSITION_H_INCLUDED
+
+#include <atomic>
+#include <stdint.h>
+
+/*
+* Result of a search stored in the transposition table
+*/
+struct TTEntry
+{
+	int score;
+	int depth;
+	int bound;		// TranspositionTable::Bound
+	uint16_t move;	// best move in packed 16 bit form, 0 if none
+};
+
+/*
+* Direct-mapped hash table of search results, indexed by position key. Each
+* slot holds one 64 bit word of data and the key xor'ed with it, so a slot
+* torn by concurrent writers fails verification instead of giving a wrong
+* result. That makes it safe to share the table between processes without
+* locks.
+*/
+class TranspositionTable
+{
+	public:
+
+		enum Bound { None = 0, Upper = 1, Lower = 2, Exact = 3 };
+
+		/*
+		* Number of entries is rounded down to a power of two. The table is
+		* put on huge pages if possible and on the NUMA node of the calling
+		* thread.
+		*/
+		TranspositionTable(unsigned long entries);
+
+		/*
+		* Table in the named shared memory segment, created if it does not
+		* exist yet. Other processes opening the same name with the same
+		* number of entries share the results. Huge pages are used if
+		* hugetlbfs is mounted at /dev/hugepages, otherwise they are asked
+		* for. Falls back to a private table if the segment cannot be
+		* mapped or name is NULL.
+		*/
+		TranspositionTable(unsigned long entries, const char * name);
+
+		~TranspositionTable();
+
+		/*
+		* True if an entry for key was found
+		*/
+		bool probe(uint64_t key, TTEntry & entry) const;
+
+		/*
+		* Store a search result. Deeper results for the same position are
+		* kept unless the new one is exact.
+		*/
+		void store(uint64_t key, int depth, int score, int bound, uint16_t move);
+
+		/*
+		* Forget everything, for every process sharing the table
+		*/
+		void clear(void);
+
+		/*
+		* True if the table lives in shared memory
+		*/
+		bool isShared(void) const;
+
+		/*
+		* Delete the named segment. Processes using it keep their mapping.
+		*/
+		static void remove(const char * name);
+
+	protected:
+
+		/*
+		* Other threads and processes write the words at any time, so they
+		* are atomics, read and written relaxed. Lock free, they have the
+		* layout of plain words in shared memory.
+		*/
+		struct Slot
+		{
+			std::atomic<uint64_t> check;	// key ^ data
+			std::atomic<uint64_t> data;	// move, depth, bound and score
+		};
+
+		/*
+		* Power of two not above entries
+		*/
+		static unsigned long roundEntries(unsigned long entries);
+
+		Slot * slots;
+		uint64_t mask;
+		size_t mapped;	// bytes mapped for a shared table, 0 if private
+};
+
+#endif
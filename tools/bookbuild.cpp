@@ -0,0 +1,511 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include "book.h"
+#include "chessboard.h"
+#include "mappedfile.h"
+#include "pgn.h"
+
+using namespace std;
+
+static void usage(void)
+{
+	printf("Usage: bookbuild [options] FILE...\n\n"
+		"Replays the games of the PGN files and writes the moves played in\n"
+		"their first plies as an opening book.\n\n"
+		"  -out FILE          book to write (default book.bin)\n"
+		"  -plies N           plies of each game that go in (default 30)\n"
+		"  -min N             games a move needs to go in (default 1)\n"
+		"  -memory MB         statistics held in memory, the rest is spilled\n"
+		"                     to temporary files next to the book (default 256)\n"
+		"  -threads N         files read in parallel (default: all cores)\n"
+		"  -check             compare the keys of a few lines with the published\n"
+		"                     Polyglot keys and exit\n");
+}
+
+/*
+* Lines of the Polyglot book format description and the keys of the
+* positions after each of their moves
+*/
+struct KeyLine
+{
+	const char * moves[8];
+	uint64_t keys[8];
+};
+
+static const KeyLine key_lines[] = {
+	{ { "e4", "d5", "e5", "f5", "Ke2", "Kf7", NULL },
+		{ 0x823C9B50FD114196ULL, 0x0756B94461C50FB0ULL, 0x662FAFB965DB29D4ULL,
+		  0x22A48B5A8E47FF78ULL, 0x652A607CA3F242C1ULL, 0x00FDD303C946BDD9ULL } },
+	{ { "a4", "b5", "h4", "b4", "c4", "bxc3", "Ra3", NULL },
+		{ 0, 0, 0, 0, 0x3C8123EA7B067637ULL, 0, 0x5C3F9B829B279560ULL } }
+};
+
+/*
+* True if bookKey hashes the start position and the test lines like
+* Polyglot does
+*/
+static bool checkKeys(void)
+{
+	ChessBoard board;
+	uint64_t key;
+	int color, i, j;
+	bool ok = true;
+
+	board.initDefaultSetup();
+	if((key = bookKey(board, WHITE)) != 0x463B96181691FC9CULL) {
+		printf("Start position: %016llx, expected 463b96181691fc9c\n", (unsigned long long)key);
+		ok = false;
+	}
+
+	for(i = 0; i < (int)(sizeof(key_lines) / sizeof(key_lines[0])); i++)
+	{
+		board.initDefaultSetup();
+		color = WHITE;
+
+		for(j = 0; key_lines[i].moves[j]; j++)
+		{
+			if(!playSAN(board, color, key_lines[i].moves[j])) {
+				printf("Line %d: no legal move %s\n", i + 1, key_lines[i].moves[j]);
+				ok = false;
+				break;
+			}
+
+			key = bookKey(board, color);
+			if(key_lines[i].keys[j] != 0 && key != key_lines[i].keys[j]) {
+				printf("Line %d after %s: %016llx, expected %016llx\n", i + 1,
+					key_lines[i].moves[j], (unsigned long long)key,
+					(unsigned long long)key_lines[i].keys[j]);
+				ok = false;
+			}
+		}
+	}
+
+	printf("Polyglot keys %s\n", ok ? "OK" : "FAILED");
+	return ok;
+}
+
+/*
+* Results of a move in a position, for the side that played it. Also the
+* record of the sorted runs spilled to disk.
+*/
+struct MoveStats
+{
+	uint64_t key;
+	uint16_t move;		// encodeBookMove(), 0 marks a free slot
+	uint16_t reserved;	// zero
+	uint32_t results[3];	// games lost, drawn and won
+};
+
+static_assert(sizeof(MoveStats) == 24, "MoveStats has to fit into 24 bytes");
+
+static bool operator<(const MoveStats & a, const MoveStats & b)
+{
+	return a.key < b.key || (a.key == b.key && a.move < b.move);
+}
+
+/*
+* Hash table of move statistics with a fixed number of slots, a power of
+* two. It is written out as a sorted run and emptied before it gets too
+* full to probe quickly.
+*/
+class StatsTable
+{
+	public:
+
+		StatsTable(size_t size) : slots(size), used(0)
+		{
+			memset(&slots[0], 0, slots.size() * sizeof(MoveStats));
+		}
+
+		void add(uint64_t key, uint16_t move, int result)
+		{
+			size_t i = (key ^ (key >> 32) ^ move * 0x9E3779B97F4A7C15ULL) & (slots.size() - 1);
+
+			while(slots[i].move != 0 && (slots[i].key != key || slots[i].move != move))
+				i = (i + 1) & (slots.size() - 1);
+
+			if(slots[i].move == 0) {
+				slots[i].key = key;
+				slots[i].move = move;
+				used++;
+			}
+
+			slots[i].results[result]++;
+		}
+
+		bool isFull(void) const
+		{
+			return used >= slots.size() / 4 * 3;
+		}
+
+		bool isEmpty(void) const
+		{
+			return used == 0;
+		}
+
+		/*
+		* Write the entries sorted by key and move and empty the table.
+		* Returns false if the file could not be written.
+		*/
+		bool spill(const char * filename)
+		{
+			vector<MoveStats> run;
+			FILE * file;
+			bool ok;
+
+			run.reserve(used);
+			for(size_t i = 0; i < slots.size(); i++)
+				if(slots[i].move != 0)
+					run.push_back(slots[i]);
+
+			sort(run.begin(), run.end());
+
+			memset(&slots[0], 0, slots.size() * sizeof(MoveStats));
+			used = 0;
+
+			if((file = fopen(filename, "wb")) == NULL)
+				return false;
+
+			ok = fwrite(&run[0], sizeof(MoveStats), run.size(), file) == run.size();
+			return (fclose(file) == 0) && ok;
+		}
+
+	protected:
+
+		vector<MoveStats> slots;
+		size_t used;
+};
+
+/*
+* Settings and shared state of all reader threads
+*/
+struct Builder
+{
+	const char * output;
+	vector<const char *> inputs;
+	int max_plies;
+	size_t slots;
+
+	atomic<int> next_input, next_run;
+
+	// runs written so far and progress, guarded by lock
+	mutex lock;
+	vector<string> runs;
+	long games, positions, errors;
+	bool failed;
+};
+
+static bool spill(Builder & builder, StatsTable & table)
+{
+	char suffix[32];
+	string name;
+
+	snprintf(suffix, sizeof(suffix), ".%05d.run", builder.next_run++);
+	name = string(builder.output) + suffix;
+
+	if(!table.spill(name.c_str())) {
+		fprintf(stderr, "Could not write %s\n", name.c_str());
+		remove(name.c_str());
+		return false;
+	}
+
+	lock_guard<mutex> guard(builder.lock);
+	builder.runs.push_back(name);
+
+	return true;
+}
+
+static void worker(Builder & builder)
+{
+	StatsTable table(builder.slots);
+	PGNReader reader;
+	PGNGame game;
+	ChessBoard board;
+	Move move;
+	long games = 0, positions = 0, errors = 0;
+	uint64_t key;
+	int input, color, result, ply;
+	bool ok = true;
+
+	while(ok && (input = builder.next_input++) < (int)builder.inputs.size())
+	{
+		if(!reader.open(builder.inputs[input])) {
+			fprintf(stderr, "Could not open %s\n", builder.inputs[input]);
+			ok = false;
+			break;
+		}
+
+		while(ok && reader.readGame(game))
+		{
+			// result for white in half points, unfinished games do not count
+			if(game.result == "1-0")
+				result = 2;
+			else if(game.result == "0-1")
+				result = 0;
+			else if(game.result == "1/2-1/2")
+				result = 1;
+			else
+				continue;
+
+			if(!game.getStartPosition(board, color)) {
+				errors++;
+				continue;
+			}
+
+			for(ply = 0; ply < game.getMoveCount() && ply < builder.max_plies; ply++)
+			{
+				key = bookKey(board, color);
+
+				if(!playSAN(board, color, game.getMove(ply), &move)) {
+					errors++;
+					break;
+				}
+
+				// color is the opponent's now
+				table.add(key, encodeBookMove(move), color ? result : 2 - result);
+				positions++;
+
+				if(table.isFull() && !spill(builder, table)) {
+					ok = false;
+					break;
+				}
+			}
+
+			games++;
+		}
+
+		reader.close();
+	}
+
+	if(ok && !table.isEmpty())
+		ok = spill(builder, table);
+
+	lock_guard<mutex> guard(builder.lock);
+	builder.games += games;
+	builder.positions += positions;
+	builder.errors += errors;
+	builder.failed |= !ok;
+}
+
+/*
+* Cursor into one of the runs being merged
+*/
+struct RunCursor
+{
+	const MoveStats * next, * end;
+
+	// the smallest entry comes first out of the priority queue
+	bool operator<(const RunCursor & b) const
+	{
+		return *b.next < *next;
+	}
+};
+
+/*
+* Weights of the moves of one position, 2 per win and 1 per draw like
+* Polyglot, scaled down to 16 bits if needed. Returns the entries written.
+*/
+static long writePosition(FILE * file, const vector<MoveStats> & moves, int min_games)
+{
+	vector<uint64_t> weights(moves.size());
+	uint64_t most = 0;
+	BookEntry entry;
+	long written = 0;
+	size_t i;
+
+	for(i = 0; i < moves.size(); i++)
+	{
+		if(moves[i].results[0] + moves[i].results[1] + moves[i].results[2] < (uint32_t)min_games)
+			continue;
+
+		weights[i] = 2 * (uint64_t)moves[i].results[2] + moves[i].results[1];
+		most = max(most, weights[i]);
+	}
+
+	for(i = 0; i < moves.size(); i++)
+	{
+		// moves that never scored are left out
+		if(weights[i] == 0)
+			continue;
+
+		if(most > 0xFFFF)
+			weights[i] = max((uint64_t)1, weights[i] * 0xFFFF / most);
+
+		entry = makeBookEntry(moves[i].key, moves[i].move, weights[i]);
+		if(fwrite(&entry, sizeof(entry), 1, file) != 1)
+			return -1;
+
+		written++;
+	}
+
+	return written;
+}
+
+/*
+* Merge the sorted runs into the book, adding up the statistics of the
+* same move found in several runs. Returns the entries written, -1 on
+* errors.
+*/
+static long merge(const vector<string> & runs, const char * output, int min_games)
+{
+	vector< RecordFile<MoveStats> > files(runs.size());
+	priority_queue<RunCursor> queue;
+	vector<MoveStats> moves;
+	string tmp = string(output) + ".tmp";
+	RunCursor cursor;
+	MoveStats current;
+	long entries = 0, written;
+	FILE * file;
+	size_t i;
+	int j;
+
+	for(i = 0; i < runs.size(); i++)
+	{
+		if(!files[i].open(runs[i].c_str())) {
+			fprintf(stderr, "Could not read %s\n", runs[i].c_str());
+			return -1;
+		}
+
+		if(files[i].size() > 0) {
+			cursor.next = files[i].begin();
+			cursor.end = files[i].end();
+			queue.push(cursor);
+		}
+	}
+
+	if((file = fopen(tmp.c_str(), "wb")) == NULL)
+		return -1;
+
+	memset(&current, 0, sizeof(current));
+
+	while(!queue.empty() && entries >= 0)
+	{
+		cursor = queue.top();
+		queue.pop();
+
+		if(current.move != 0 && cursor.next->key == current.key && cursor.next->move == current.move) {
+			// the same move from another run
+			for(j = 0; j < 3; j++)
+				current.results[j] += cursor.next->results[j];
+		}
+		else {
+			if(current.move != 0)
+				moves.push_back(current);
+
+			// all moves of a position are together
+			if(!moves.empty() && moves.back().key != cursor.next->key) {
+				written = writePosition(file, moves, min_games);
+				entries = (written < 0) ? -1 : entries + written;
+				moves.clear();
+			}
+
+			current = *cursor.next;
+		}
+
+		if(++cursor.next != cursor.end)
+			queue.push(cursor);
+	}
+
+	if(current.move != 0 && entries >= 0) {
+		moves.push_back(current);
+		written = writePosition(file, moves, min_games);
+		entries = (written < 0) ? -1 : entries + written;
+	}
+
+	if(fclose(file) != 0 || entries < 0 || rename(tmp.c_str(), output) != 0) {
+		remove(tmp.c_str());
+		return -1;
+	}
+
+	return entries;
+}
+
+int main(int argc, char ** argv)
+{
+	Builder builder;
+	vector<thread> workers;
+	int threads, min_games = 1, i;
+	long memory = 256, entries;
+	double seconds;
+
+	builder.output = "book.bin";
+	builder.max_plies = 30;
+
+	if((threads = thread::hardware_concurrency()) < 1)
+		threads = 1;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-out") == 0 && i + 1 < argc)
+			builder.output = argv[++i];
+		else if(strcmp(argv[i], "-plies") == 0 && i + 1 < argc)
+			builder.max_plies = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-min") == 0 && i + 1 < argc)
+			min_games = max(1, atoi(argv[++i]));
+		else if(strcmp(argv[i], "-memory") == 0 && i + 1 < argc)
+			memory = max(1, atoi(argv[++i]));
+		else if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+			threads = max(1, atoi(argv[++i]));
+		else if(strcmp(argv[i], "-check") == 0)
+			return checkKeys() ? 0 : 1;
+		else if(argv[i][0] != '-' || strcmp(argv[i], "-") == 0)
+			builder.inputs.push_back(argv[i]);
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	if(builder.inputs.empty()) {
+		usage();
+		return 1;
+	}
+
+	// no more threads than files, each gets a table of its own
+	threads = min(threads, (int)builder.inputs.size());
+	for(builder.slots = 1024; builder.slots * 2 * sizeof(MoveStats) * threads <= (size_t)memory << 20; )
+		builder.slots *= 2;
+
+	builder.next_input = 0;
+	builder.next_run = 0;
+	builder.games = 0;
+	builder.positions = 0;
+	builder.errors = 0;
+	builder.failed = false;
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	for(i = 0; i < threads; i++)
+		workers.push_back(thread(worker, ref(builder)));
+
+	for(i = 0; i < threads; i++)
+		workers[i].join();
+
+	entries = builder.failed ? -1 : merge(builder.runs, builder.output, min_games);
+
+	for(i = 0; i < (int)builder.runs.size(); i++)
+		remove(builder.runs[i].c_str());
+
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	if(entries < 0) {
+		fprintf(stderr, "Could not write %s\n", builder.output);
+		return 1;
+	}
+
+	printf("%ld games, %ld positions, %ld errors, %lu runs, %ld book entries in %.2f s\n",
+		builder.games, builder.positions, builder.errors,
+		(unsigned long)builder.runs.size(), entries, seconds);
+
+	return 0;
+}
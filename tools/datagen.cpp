@@ -0,0 +1,435 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "aiplayer.h"
+#include "chessboard.h"
+#include "mappedfile.h"
+#include "placement.h"
+#include "trainingdata.h"
+
+using namespace std;
+
+// Keys remembered to skip positions seen before, a power of two
+#define SEEN_KEYS (1 << 23)
+
+// Slots tried per key before it is given up
+#define SEEN_PROBES 8
+
+static void usage(void)
+{
+	printf("Usage: datagen [options]\n\n"
+		"  -games N           number of games to play (default 1000)\n"
+		"  -nodes N           nodes searched per move (default 5000)\n"
+		"  -random N          random plies at the start of a game (default 8)\n"
+		"  -maxplies N        adjudicate longer games as draws (default 400)\n"
+		"  -shard N           positions per output file (default 100000)\n"
+		"  -threads N         games played in parallel (default: all cores)\n"
+		"  -seed N            seed of the random plies (default: time)\n"
+		"  -out PREFIX        output files PREFIX-NNNNN.bin (default data)\n"
+		"  -check             pack and unpack a few positions, check that damaged\n"
+		"                     records are refused and exit\n");
+}
+
+/*
+* Positions packed and unpacked by -check, with castling rights, en
+* passant targets and a halfmove clock
+*/
+static const char * check_fens[] = {
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"rnbqkbnr/pp1ppppp/8/2p5/4P3/8/PPPP1PPP/RNBQKBNR w KQkq c6 0 2",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 7 30",
+	"r3k2r/8/8/8/8/8/8/R3K2R b Kq - 3 20"
+};
+
+/*
+* Positions and a castling flag each has no king and rook for
+*/
+static const struct {
+	const char * fen;
+	uint8_t flag;
+} damaged[] = {
+	{ "rnbq1bnr/ppppkppp/8/4p3/4P3/8/PPPPKPPP/RNBQ1BNR w - - 2 3", PACKED_WHITE_SHORT },
+	{ "rnbq1bnr/ppppkppp/8/4p3/4P3/8/PPPPKPPP/RNBQ1BNR w - - 2 3", PACKED_BLACK_LONG },
+	{ "4k3/8/8/8/8/8/8/3QK3 w - - 0 1", PACKED_WHITE_LONG },
+	{ "4k3/8/8/8/8/8/8/4KQ2 w - - 0 1", PACKED_WHITE_SHORT },
+	{ "4q3/8/8/8/8/8/8/3K4 b - - 0 1", PACKED_BLACK_SHORT }
+};
+
+/*
+* True if the positions come back from their packed form as they were and
+* the damaged records are refused
+*/
+static bool checkPacking(void)
+{
+	ChessBoard board, unpacked;
+	PackedBoard packed;
+	char before[FEN_LENGTH], after[FEN_LENGTH];
+	int color, unpacked_color, i;
+	bool ok = true;
+
+	for(i = 0; i < (int)(sizeof(check_fens) / sizeof(check_fens[0])); i++)
+	{
+		board.initFEN(check_fens[i], color);
+		board.pack(color, packed);
+
+		if(!unpacked.initPacked(packed, unpacked_color)) {
+			printf("Refused: %s\n", check_fens[i]);
+			ok = false;
+			continue;
+		}
+
+		board.toFEN(color, before);
+		unpacked.toFEN(unpacked_color, after);
+		if(strcmp(before, after) != 0) {
+			printf("Packed %s\n  unpacked %s\n", before, after);
+			ok = false;
+		}
+	}
+
+	for(i = 0; i < (int)(sizeof(damaged) / sizeof(damaged[0])); i++)
+	{
+		board.initFEN(damaged[i].fen, color);
+		board.pack(color, packed);
+		packed.flags |= damaged[i].flag;
+
+		if(unpacked.initPacked(packed, unpacked_color)) {
+			unpacked.toFEN(unpacked_color, after);
+			printf("Flags %02x of %s\n  unpacked as %s\n", packed.flags, damaged[i].fen, after);
+			ok = false;
+		}
+	}
+
+	printf("Packing %s\n", ok ? "OK" : "FAILED");
+	return ok;
+}
+
+/*
+* Set of position keys shared by all threads, without locks. When all
+* slots of a key are taken it is not remembered, so a few duplicates get
+* through once the set fills up.
+*/
+class KeySet
+{
+	public:
+
+		KeySet() : slots(SEEN_KEYS)
+		{
+			for(size_t i = 0; i < slots.size(); i++)
+				slots[i] = 0;
+		}
+
+		/*
+		* False if the key was inserted before
+		*/
+		bool insert(uint64_t key)
+		{
+			uint64_t expected;
+			int i;
+
+			// 0 marks free slots
+			if(key == 0)
+				key = 1;
+
+			for(i = 0; i < SEEN_PROBES; i++)
+			{
+				atomic<uint64_t> & slot = slots[(key + i) & (SEEN_KEYS - 1)];
+
+				expected = 0;
+				if(slot.compare_exchange_strong(expected, key))
+					return true;
+				if(expected == key)
+					return false;
+			}
+
+			return true;
+		}
+
+	protected:
+
+		vector< atomic<uint64_t> > slots;
+};
+
+/*
+* Settings and shared state of all generator threads
+*/
+struct Generator
+{
+	const char * prefix;
+	int games, nodes, random_plies, max_plies, shard_size;
+	unsigned int seed;
+
+	KeySet seen;
+	atomic<int> next_game, next_shard;
+
+	// progress, guarded by lock
+	mutex lock;
+	long positions, played;
+	chrono::steady_clock::time_point start;
+
+	// set by the thread that cannot write its shard, polled by all
+	atomic<bool> failed;
+};
+
+/*
+* Packs the position and tells if it was not seen before. The key comes
+* from the packed form, which drops flags that no longer matter, like
+* those of rooks whose king has moved, so it is the same as on resume.
+*/
+static bool isNew(Generator & gen, const ChessBoard & board, int color,
+	PackedBoard & packed, ChessBoard & unpacked)
+{
+	board.pack(color, packed);
+
+	return unpacked.initPacked(packed, color) && gen.seen.insert(unpacked.getKey(color));
+}
+
+/*
+* Result of a finished game for white in half points
+*/
+static int playGame(Generator & gen, int game, vector<TrainingRecord> & records)
+{
+	ChessBoard board, unpacked;
+	list<Move> regulars, nulls, legal;
+	TrainingRecord record;
+	AnalysisLine line;
+	Move move;
+	unsigned int seed = gen.seed + game;
+	ChessPlayer::Status status;
+	int turn = WHITE, ply, first = records.size(), result = 1;
+	bool in_check;
+	size_t i;
+
+	AIPlayer white(WHITE, MAX_PLY / 2);
+	AIPlayer black(BLACK, MAX_PLY / 2);
+
+	white.setNodeLimit(gen.nodes);
+	black.setNodeLimit(gen.nodes);
+	white.setSeed(seed);
+	black.setSeed(seed + 1);
+
+	board.initDefaultSetup();
+
+	for(ply = 0; ply < gen.max_plies; ply++)
+	{
+		status = board.getPlayerStatus(turn);
+		if(status == ChessPlayer::Checkmate) {
+			result = turn ? 2 : 0;
+			break;
+		}
+		if(status == ChessPlayer::Stalemate || status == ChessPlayer::Draw)
+			break;
+
+		// maintenance moves first, so stale en passant flags do not make
+		// equal positions look different
+		regulars.clear();
+		nulls.clear();
+		board.getMoves(turn, regulars, regulars, nulls);
+
+		for(list<Move>::iterator it = nulls.begin(); it != nulls.end(); ++it)
+			board.move(*it);
+
+		in_check = board.isVulnerable((turn ? board.black_king_pos : board.white_king_pos), turn);
+
+		// random openings, so games do not repeat
+		if(ply < gen.random_plies) {
+			legal.clear();
+			for(list<Move>::iterator it = regulars.begin(); it != regulars.end(); ++it)
+			{
+				board.move(*it);
+				if(!board.isVulnerable((turn ? board.black_king_pos : board.white_king_pos), turn))
+					legal.push_back(*it);
+				board.undoMove(*it);
+			}
+
+			list<Move>::iterator it = legal.begin();
+			advance(it, rand_r(&seed) % legal.size());
+			move = *it;
+		}
+		else {
+			if(!(turn ? black : white).getMove(board, move, line)) {
+				result = turn ? 2 : 0;
+				break;
+			}
+
+			// quiet positions only, with a score that is no mate
+			if(!in_check && move.capture == EMPTY && move.promotion == EMPTY
+				&& line.score > -WIN_VALUE + MAX_PLY && line.score < WIN_VALUE - MAX_PLY
+				&& isNew(gen, board, turn, record.board, unpacked))
+			{
+				record.score = line.score;
+				record.move = move.pack();
+				record.ply = ply;
+				record.result = 1;
+				record.reserved = 0;
+				records.push_back(record);
+			}
+		}
+
+		board.move(move);
+		turn = TOGGLE_COLOR(turn);
+	}
+
+	// results from the point of view of the side to move
+	for(i = first; i < records.size(); i++)
+		records[i].result = (records[i].board.flags & PACKED_BLACK) ? 2 - result : result;
+
+	return result;
+}
+
+/*
+* Writes a shard and reports progress
+*/
+static void flush(Generator & gen, vector<TrainingRecord> & records)
+{
+	double seconds;
+	int shard;
+
+	if(records.empty())
+		return;
+
+	shard = gen.next_shard++;
+
+	lock_guard<mutex> guard(gen.lock);
+
+	if(!writeShard(gen.prefix, shard, records.data(), records.size())) {
+		fprintf(stderr, "Could not write %s\n", shardName(gen.prefix, shard).c_str());
+		gen.failed = true;
+	}
+	else {
+		gen.positions += records.size();
+		seconds = chrono::duration<double>(chrono::steady_clock::now() - gen.start).count();
+		printf("%s: %lu positions, %ld games, %ld positions in total, %.0f/s\n",
+			shardName(gen.prefix, shard).c_str(), (unsigned long)records.size(),
+			gen.played, gen.positions, gen.positions / seconds);
+		fflush(stdout);
+	}
+
+	records.clear();
+}
+
+static void worker(Generator & gen, int index, int count)
+{
+	vector<TrainingRecord> records;
+	int game;
+
+	bindThread(index, count);
+	records.reserve(gen.shard_size + gen.max_plies);
+
+	while(!gen.failed && (game = gen.next_game++) < gen.games)
+	{
+		playGame(gen, game, records);
+
+		{
+			lock_guard<mutex> guard(gen.lock);
+			gen.played++;
+		}
+
+		if((int)records.size() >= gen.shard_size)
+			flush(gen, records);
+	}
+
+	// the rest goes into a smaller shard
+	flush(gen, records);
+}
+
+/*
+* Remember the positions of earlier runs, so they are not generated again,
+* and continue after their last shard. Returns the number of positions.
+*/
+static long resume(Generator & gen)
+{
+	vector<int> shards = listShards(gen.prefix);
+	RecordFile<TrainingRecord> records;
+	ChessBoard board;
+	long positions = 0;
+	int color;
+
+	for(size_t i = 0; i < shards.size(); i++)
+	{
+		if(!records.open(shardName(gen.prefix, shards[i]).c_str()))
+			continue;
+
+		for(const TrainingRecord * it = records.begin(); it != records.end(); ++it)
+			if(board.initPacked(it->board, color))
+				gen.seen.insert(board.getKey(color));
+
+		positions += records.size();
+	}
+
+	gen.next_shard = shards.empty() ? 0 : shards.back() + 1;
+
+	return positions;
+}
+
+int main(int argc, char ** argv)
+{
+	Generator gen;
+	vector<thread> workers;
+	int threads, i;
+	long found;
+
+	gen.prefix = "data";
+	gen.games = 1000;
+	gen.nodes = 5000;
+	gen.random_plies = 8;
+	gen.max_plies = 400;
+	gen.shard_size = 100000;
+	gen.seed = time(NULL);
+
+	if((threads = thread::hardware_concurrency()) < 1)
+		threads = 1;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-games") == 0 && i + 1 < argc)
+			gen.games = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-nodes") == 0 && i + 1 < argc)
+			gen.nodes = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-random") == 0 && i + 1 < argc)
+			gen.random_plies = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-maxplies") == 0 && i + 1 < argc)
+			gen.max_plies = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-shard") == 0 && i + 1 < argc)
+			gen.shard_size = max(1, atoi(argv[++i]));
+		else if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+			threads = max(1, atoi(argv[++i]));
+		else if(strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+			gen.seed = strtoul(argv[++i], NULL, 10);
+		else if(strcmp(argv[i], "-out") == 0 && i + 1 < argc)
+			gen.prefix = argv[++i];
+		else if(strcmp(argv[i], "-check") == 0)
+			return checkPacking() ? 0 : 1;
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	if((found = resume(gen)) > 0)
+		printf("Resuming after %ld positions, next shard %s\n", found,
+			shardName(gen.prefix, gen.next_shard).c_str());
+
+	gen.next_game = 0;
+	gen.positions = 0;
+	gen.played = 0;
+	gen.failed = false;
+	gen.start = chrono::steady_clock::now();
+
+	for(i = 0; i < threads; i++)
+		workers.push_back(thread(worker, ref(gen), i, threads));
+
+	for(i = 0; i < threads; i++)
+		workers[i].join();
+
+	printf("%ld games, %ld new positions\n", gen.played, gen.positions);
+
+	return gen.failed ? 1 : 0;
+}
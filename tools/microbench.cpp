@@ -0,0 +1,272 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <new>
+#include "chessboard.h"
+#include "aiplayer.h"
+
+using namespace std;
+
+// Openings, middle games and endings, with castling, en passant and
+// promotions
+static const char * positions[] = {
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"rnbqkb1r/pp1p1ppp/4pn2/2pP4/2P5/8/PP2PPPP/RNBQKBNR w KQkq c6 0 4",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+	"n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1"
+};
+
+#define POSITIONS ((int)(sizeof(positions) / sizeof(positions[0])))
+
+// Every benchmark runs at least this long
+#define MIN_SECONDS 0.2
+
+/*
+* Counts calls of the global operator new, that is list nodes and vectors.
+*/
+static unsigned long allocations = 0;
+
+void * operator new(size_t size)
+{
+	void * p;
+
+	allocations++;
+	if((p = malloc(size ? size : 1)) == NULL)
+		throw bad_alloc();
+
+	return p;
+}
+
+void operator delete(void * p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void * p, size_t) noexcept
+{
+	free(p);
+}
+
+/*
+* One position of the corpus, prepared so that the primitives can be
+* called on it directly.
+*/
+struct Sample
+{
+	ChessBoard board;
+	int color;
+	list<Move> regulars;	// all moves of the side to move
+};
+
+static Sample samples[POSITIONS];
+static AIPlayer * evaluator;
+
+// results are added up here, so the calls cannot be optimized away
+static volatile long sink;
+
+/*
+* A benchmark walks the whole corpus once and returns the number of
+* primitive calls it made.
+*/
+typedef long (*Benchmark)(int figure);
+
+static long benchGetMoves(int)
+{
+	long calls = 0;
+
+	for(int i = 0; i < POSITIONS; i++)
+	{
+		list<Move> regulars, nulls;
+
+		samples[i].board.getMoves(samples[i].color, regulars, regulars, nulls);
+		sink += regulars.size();
+		calls++;
+	}
+
+	return calls;
+}
+
+static long benchPieceMoves(int figure)
+{
+	long calls = 0;
+	int pos, own;
+
+	for(int i = 0; i < POSITIONS; i++)
+	{
+		ChessBoard & board = samples[i].board;
+
+		for(pos = 0; pos < 64; pos++)
+		{
+			own = board.square[pos];
+			if(FIGURE(own) != figure || IS_BLACK(own) != samples[i].color)
+				continue;
+
+			list<Move> moves, captures, nulls;
+
+			switch(figure)
+			{
+				case PAWN:
+					board.getPawnMoves(own, pos, moves, captures, nulls);
+					break;
+				case ROOK:
+					board.getRookMoves(own, pos, moves, captures);
+					break;
+				case KNIGHT:
+					board.getKnightMoves(own, pos, moves, captures);
+					break;
+				case BISHOP:
+					board.getBishopMoves(own, pos, moves, captures);
+					break;
+				case QUEEN:
+					board.getQueenMoves(own, pos, moves, captures);
+					break;
+				case KING:
+					board.getKingMoves(own, pos, moves, captures);
+					break;
+			}
+
+			sink += moves.size() + captures.size();
+			calls++;
+		}
+	}
+
+	return calls;
+}
+
+static long benchIsVulnerable(int)
+{
+	long calls = 0;
+
+	for(int i = 0; i < POSITIONS; i++)
+	{
+		for(int pos = 0; pos < 64; pos++)
+		{
+			sink += samples[i].board.isVulnerable(pos, samples[i].color);
+			calls++;
+		}
+	}
+
+	return calls;
+}
+
+static long benchMoveUndo(int)
+{
+	long calls = 0;
+
+	for(int i = 0; i < POSITIONS; i++)
+	{
+		ChessBoard & board = samples[i].board;
+
+		for(list<Move>::iterator it = samples[i].regulars.begin(); it != samples[i].regulars.end(); ++it)
+		{
+			board.move(*it);
+			board.undoMove(*it);
+			calls++;
+		}
+
+		sink += board.hash;
+	}
+
+	return calls;
+}
+
+static long benchEvaluateBoard(int)
+{
+	long calls = 0;
+
+	for(int i = 0; i < POSITIONS; i++)
+	{
+		sink += evaluator->evaluateBoard(samples[i].board);
+		calls++;
+	}
+
+	return calls;
+}
+
+/*
+* Repeats the benchmark until it ran long enough and prints time and
+* allocations per primitive call.
+*/
+static void run(const char * name, Benchmark benchmark, int figure)
+{
+	long calls = 0, rounds, r;
+	unsigned long allocated;
+	double seconds = 0;
+
+	// warm up caches and the allocator
+	benchmark(figure);
+
+	for(rounds = 1; ; rounds *= 2)
+	{
+		calls = 0;
+		allocated = allocations;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+		for(r = 0; r < rounds; r++)
+			calls += benchmark(figure);
+
+		seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		allocated = allocations - allocated;
+
+		if(seconds >= MIN_SECONDS)
+			break;
+	}
+
+	printf("%-24s %12ld %10.1f ns/op %8.2f allocs/op\n", name, calls,
+		seconds * 1e9 / calls, (double)allocated / calls);
+}
+
+int main(int argc, char ** argv)
+{
+	const char * filter = (argc > 1) ? argv[1] : NULL;
+	AIPlayer player(WHITE, 1);
+	list<Move> nulls;
+	int i;
+
+	static const struct {
+		const char * name;
+		Benchmark benchmark;
+		int figure;
+	} benchmarks[] = {
+		{ "getMoves",            benchGetMoves,      EMPTY  },
+		{ "getPawnMoves",        benchPieceMoves,    PAWN   },
+		{ "getRookMoves",        benchPieceMoves,    ROOK   },
+		{ "getKnightMoves",      benchPieceMoves,    KNIGHT },
+		{ "getBishopMoves",      benchPieceMoves,    BISHOP },
+		{ "getQueenMoves",       benchPieceMoves,    QUEEN  },
+		{ "getKingMoves",        benchPieceMoves,    KING   },
+		{ "isVulnerable",        benchIsVulnerable,  EMPTY  },
+		{ "move/undoMove",       benchMoveUndo,      EMPTY  },
+		{ "evaluateBoard",       benchEvaluateBoard, EMPTY  }
+	};
+
+	for(i = 0; i < POSITIONS; i++)
+	{
+		samples[i].board.initFEN(positions[i], samples[i].color);
+		samples[i].board.getMoves(samples[i].color, samples[i].regulars, samples[i].regulars, nulls);
+
+		// passant flags are cleared like the game loop does
+		for(list<Move>::iterator it = nulls.begin(); it != nulls.end(); ++it)
+			samples[i].board.move(*it);
+		nulls.clear();
+	}
+
+	evaluator = &player;
+
+	printf("%-24s %12s %13s %18s\n", "Benchmark", "Calls", "Time", "Allocations");
+
+	for(i = 0; i < (int)(sizeof(benchmarks) / sizeof(benchmarks[0])); i++)
+	{
+		// run only benchmarks whose name contains the argument
+		if(filter && !strstr(benchmarks[i].name, filter))
+			continue;
+
+		run(benchmarks[i].name, benchmarks[i].benchmark, benchmarks[i].figure);
+	}
+
+	return 0;
+}
@@ -0,0 +1,107 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <list>
+#include "chessboard.h"
+
+using namespace std;
+
+// Positions with castling, en passant and promotions
+static const char * positions[] = {
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+	"n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1"
+};
+
+/*
+* Walks all legal lines to the given depth like a search would do and
+* counts the leaves.
+*/
+static long walk(ChessBoard & board, int color, int depth)
+{
+	list<Move> regulars, nulls;
+	long leaves = 0;
+
+	if(depth == 0)
+		return 1;
+
+	board.getMoves(color, regulars, regulars, nulls);
+
+	for(list<Move>::iterator it = nulls.begin(); it != nulls.end(); ++it)
+		board.move(*it);
+
+	for(list<Move>::iterator it = regulars.begin(); it != regulars.end(); ++it)
+	{
+		board.move(*it);
+		if(!board.isVulnerable((color ? board.black_king_pos : board.white_king_pos), color))
+			leaves += walk(board, TOGGLE_COLOR(color), depth - 1);
+		board.undoMove(*it);
+	}
+
+	for(list<Move>::iterator it = nulls.begin(); it != nulls.end(); ++it)
+		board.undoMove(*it);
+
+	return leaves;
+}
+
+int main(int argc, char ** argv)
+{
+	int depth = (argc > 1) ? atoi(argv[1]) : 4;
+	int i, j, color, rounds = 200000;
+	long leaves = 0, pairs = 0;
+	double seconds;
+
+#ifdef COPY_MAKE
+	printf("Mode: copy-make (history entry %d bytes, saved squares %d bytes)\n",
+		(int)sizeof(HistoryEntry), (int)sizeof(SavedSquares));
+#else
+	printf("Mode: make/unmake (history entry %d bytes)\n", (int)sizeof(HistoryEntry));
+#endif
+
+	// 1. make/unmake of all root moves in a tight loop
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	for(i = 0; i < (int)(sizeof(positions) / sizeof(positions[0])); i++)
+	{
+		ChessBoard board;
+		list<Move> regulars, nulls;
+
+		board.initFEN(positions[i], color);
+		board.getMoves(color, regulars, regulars, nulls);
+
+		for(list<Move>::iterator it = nulls.begin(); it != nulls.end(); ++it)
+			board.move(*it);
+
+		for(j = 0; j < rounds; j++)
+		{
+			for(list<Move>::iterator it = regulars.begin(); it != regulars.end(); ++it)
+			{
+				board.move(*it);
+				board.undoMove(*it);
+				pairs++;
+			}
+		}
+	}
+
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	printf("move/undoMove: %ld pairs in %.2fs, %.1f ns per pair\n",
+		pairs, seconds, seconds * 1e9 / pairs);
+
+	// 2. tree walk including move generation
+	start = chrono::steady_clock::now();
+
+	for(i = 0; i < (int)(sizeof(positions) / sizeof(positions[0])); i++)
+	{
+		ChessBoard board;
+
+		board.initFEN(positions[i], color);
+		leaves += walk(board, color, depth);
+	}
+
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	printf("walk depth %d: %ld leaves in %.2fs, %.0f leaves/s\n",
+		depth, leaves, seconds, leaves / seconds);
+
+	return 0;
+}
@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <thread>
+#include <vector>
+#include "chessboard.h"
+
+using namespace std;
+
+// Deepest depth with known counts in the suite
+#define SUITE_DEPTH 6
+
+/*
+* Positions with known leaf counts from depth 1 on, 0 where the count is
+* too large to be of use
+*/
+struct SuitePosition
+{
+	const char * fen;
+	uint64_t counts[SUITE_DEPTH];
+};
+
+// castling through and out of check, en passant, promotions
+static const SuitePosition suite[] = {
+	{ "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+		{ 20, 400, 8902, 197281, 4865609, 119060324 } },
+	{ "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+		{ 48, 2039, 97862, 4085603, 193690690, 0 } },
+	{ "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+		{ 14, 191, 2812, 43238, 674624, 11030083 } },
+	{ "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+		{ 6, 264, 9467, 422333, 15833292, 706045033 } },
+	{ "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+		{ 44, 1486, 62379, 2103487, 89941194, 0 } },
+	{ "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+		{ 46, 2079, 89890, 3894594, 164075551, 0 } }
+};
+
+static void usage(void)
+{
+	printf("Usage: perft [options] [FEN]\n\n"
+		"Counts the leaves of the tree of legal moves of the position, the\n"
+		"initial setup without FEN, or checks the counts of a suite of test\n"
+		"positions.\n\n"
+		"  -depth N           depth of the tree (default 5, suite 4)\n"
+		"  -divide            print the count below every root move\n"
+		"  -suite             check the test positions\n"
+		"  -hash MB           size of the table of subtree counts, 0 for none\n"
+		"                     (default 64)\n"
+		"  -threads N         root moves counted in parallel (default: all cores)\n");
+}
+
+/*
+* Leaf counts of subtrees by key and depth, shared by all threads without
+* locks. A slot holds the key xor'ed with its data, so a slot torn by two
+* threads writing at once does not verify and counts as a miss.
+*/
+class CountTable
+{
+	public:
+
+		CountTable(size_t size) : slots(size)
+		{
+			for(size_t i = 0; i < slots.size(); i++) {
+				slots[i].check = 0;
+				slots[i].data = 0;
+			}
+		}
+
+		bool probe(uint64_t key, int depth, uint64_t & count) const
+		{
+			const Slot & slot = slots[key & (slots.size() - 1)];
+			uint64_t data = slot.data.load(memory_order_relaxed);
+
+			if((slot.check.load(memory_order_relaxed) ^ data) != key || (int)(data & 0xFF) != depth)
+				return false;
+
+			count = data >> 8;
+			return true;
+		}
+
+		void store(uint64_t key, int depth, uint64_t count)
+		{
+			Slot & slot = slots[key & (slots.size() - 1)];
+			uint64_t data = (count << 8) | depth;
+
+			slot.check.store(key ^ data, memory_order_relaxed);
+			slot.data.store(data, memory_order_relaxed);
+		}
+
+		bool isEmpty(void) const
+		{
+			return slots.empty();
+		}
+
+	protected:
+
+		struct Slot
+		{
+			atomic<uint64_t> check, data;
+		};
+
+		vector<Slot> slots;
+};
+
+/*
+* Leaves below the position with color to move. The maintenance moves of
+* the side to move are made first, like in a game.
+*/
+static uint64_t perft(CountTable & table, ChessBoard & board, int color, int depth)
+{
+	list<Move> regulars, nulls;
+	list<Move>::iterator it;
+	uint64_t key = 0, leaves = 0;
+
+	if(depth >= 2 && !table.isEmpty()) {
+		key = board.getKey(color);
+		if(table.probe(key, depth, leaves))
+			return leaves;
+	}
+
+	board.getMoves(color, regulars, regulars, nulls);
+
+	for(it = nulls.begin(); it != nulls.end(); ++it)
+		board.move(*it);
+
+	for(it = regulars.begin(); it != regulars.end(); ++it)
+	{
+		board.move(*it);
+		if(!board.isVulnerable((color ? board.black_king_pos : board.white_king_pos), color))
+			leaves += (depth == 1) ? 1 : perft(table, board, TOGGLE_COLOR(color), depth - 1);
+		board.undoMove(*it);
+	}
+
+	for(it = nulls.begin(); it != nulls.end(); ++it)
+		board.undoMove(*it);
+
+	if(depth >= 2 && !table.isEmpty())
+		table.store(key, depth, leaves);
+
+	return leaves;
+}
+
+/*
+* Takes root moves one after the other and counts the leaves below each on
+* a board of its own.
+*/
+static void worker(CountTable & table, const ChessBoard & root, int color, int depth,
+	const vector<Move> & moves, vector<uint64_t> & leaves, atomic<int> & next)
+{
+	ChessBoard board = root;
+	list<Move> regulars, nulls;
+	list<Move>::iterator it;
+	int i;
+
+	board.getMoves(color, regulars, regulars, nulls);
+
+	for(it = nulls.begin(); it != nulls.end(); ++it)
+		board.move(*it);
+
+	while((i = next++) < (int)moves.size())
+	{
+		board.move(moves[i]);
+		leaves[i] = (depth == 1) ? 1 : perft(table, board, TOGGLE_COLOR(color), depth - 1);
+		board.undoMove(moves[i]);
+	}
+}
+
+/*
+* Leaves below a position, the root moves split across threads
+*/
+static uint64_t run(CountTable & table, const char * fen, int depth, int threads, bool divide)
+{
+	ChessBoard board;
+	list<Move> regulars, nulls;
+	list<Move>::iterator it;
+	vector<Move> moves;
+	vector<uint64_t> leaves;
+	vector<thread> workers;
+	atomic<int> next(0);
+	uint64_t total = 0;
+	char buf[6];
+	int color, i;
+
+	if(!board.initFEN(fen, color)) {
+		fprintf(stderr, "Malformed FEN: %s\n", fen);
+		exit(1);
+	}
+
+	// legal root moves
+	board.getMoves(color, regulars, regulars, nulls);
+
+	for(it = nulls.begin(); it != nulls.end(); ++it)
+		board.move(*it);
+
+	for(it = regulars.begin(); it != regulars.end(); ++it)
+	{
+		board.move(*it);
+		if(!board.isVulnerable((color ? board.black_king_pos : board.white_king_pos), color))
+			moves.push_back(*it);
+		board.undoMove(*it);
+	}
+
+	for(it = nulls.begin(); it != nulls.end(); ++it)
+		board.undoMove(*it);
+
+	if(depth < 1)
+		return 1;
+
+	leaves.resize(moves.size());
+
+	for(i = 0; i < min(threads, (int)moves.size()); i++)
+		workers.push_back(thread(worker, ref(table), cref(board), color, depth,
+			cref(moves), ref(leaves), ref(next)));
+
+	for(i = 0; i < (int)workers.size(); i++)
+		workers[i].join();
+
+	for(i = 0; i < (int)moves.size(); i++)
+	{
+		if(divide) {
+			moves[i].toString(buf);
+			printf("%s: %lu\n", buf, (unsigned long)leaves[i]);
+		}
+
+		total += leaves[i];
+	}
+
+	return total;
+}
+
+int main(int argc, char ** argv)
+{
+	const char * fen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+	int depth = -1, threads, failed = 0, i;
+	long hash = 64;
+	bool divide = false, run_suite = false;
+	size_t slots = 0;
+	uint64_t leaves, expected;
+	double seconds;
+
+	if((threads = thread::hardware_concurrency()) < 1)
+		threads = 1;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-depth") == 0 && i + 1 < argc)
+			depth = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-divide") == 0)
+			divide = true;
+		else if(strcmp(argv[i], "-suite") == 0)
+			run_suite = true;
+		else if(strcmp(argv[i], "-hash") == 0 && i + 1 < argc)
+			hash = max(0, atoi(argv[++i]));
+		else if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+			threads = max(1, atoi(argv[++i]));
+		else if(argv[i][0] != '-')
+			fen = argv[i];
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	if(depth < 0)
+		depth = run_suite ? 4 : 5;
+
+	// the largest power of two of slots that fits
+	if(hash > 0)
+		for(slots = 1; slots * 2 * 16 <= (size_t)hash << 20; )
+			slots *= 2;
+
+	if(!run_suite) {
+		CountTable table(slots);
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		leaves = run(table, fen, depth, threads, divide);
+		seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		printf("Depth %d: %lu leaves in %.2f s, %.0f leaves/s\n", depth,
+			(unsigned long)leaves, seconds, leaves / max(seconds, 1e-6));
+
+		return 0;
+	}
+
+	if(depth < 1 || depth > SUITE_DEPTH) {
+		fprintf(stderr, "The suite has counts for depth 1 to %d\n", SUITE_DEPTH);
+		return 1;
+	}
+
+	for(i = 0; i < (int)(sizeof(suite) / sizeof(suite[0])); i++)
+	{
+		if((expected = suite[i].counts[depth - 1]) == 0)
+			continue;
+
+		// a fresh table, so each position is counted on its own
+		CountTable table(slots);
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		leaves = run(table, suite[i].fen, depth, threads, divide);
+		seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		printf("%s %s\n  depth %d: %lu leaves, expected %lu in %.2f s\n",
+			(leaves == expected) ? "OK    " : "FAILED", suite[i].fen, depth,
+			(unsigned long)leaves, (unsigned long)expected, seconds);
+
+		failed += (leaves != expected);
+	}
+
+	printf("%d positions failed\n", failed);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,217 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <unistd.h>
+#include "chessboard.h"
+#include "pgn.h"
+
+using namespace std;
+
+static void usage(void)
+{
+	printf("Usage: pgnreplay [options] FILE...\n\n"
+		"Replays every game of the PGN files, \"-\" for stdin, and reports the\n"
+		"moves that are no legal moves.\n\n"
+		"  -write FILE        write the games again with the moves in SAN as the\n"
+		"                     engine writes them\n"
+		"  -fen FILE          write the position after every move with the game\n"
+		"                     result, one per line, the input format of tuner\n"
+		"  -quiet             do not report the single errors\n"
+		"  -check             replay a few sample games in the notations found\n"
+		"                     in the wild and exit\n");
+}
+
+/*
+* Sample games with castling written with zeros, move numbers apart from
+* and stuck to the moves, and the plies each has
+*/
+static const char * check_pgn =
+	"[Event \"Zeros\"]\n[Result \"1/2-1/2\"]\n\n"
+	"1. e4 e5 2. Nf3 Nc6 3. Bc4 Bc5 4. 0-0 Nf6 5. d3 d6 6. Bg5 h6 7. Bh4 Qe7\n"
+	"8. Nc3 Bd7 9. Qd2 0-0-0 1/2-1/2\n\n"
+	"[Event \"Stuck numbers\"]\n[Result \"1-0\"]\n\n"
+	"1.d4 d5 2.c4 e6 3.Nc3 Nf6 4.Bg5 Be7 5.e3 5...0-0 6.Nf3 Nbd7 7.Qc2 c5\n"
+	"8.0-0-0 Qa5 9.Kb1 b6 1-0\n";
+
+static const int check_plies[] = { 18, 18 };
+
+/*
+* True if the sample games are read with all their moves and replay
+*/
+static bool checkSamples(void)
+{
+	char name[] = "/tmp/pgnreplayXXXXXX";
+	PGNReader reader;
+	PGNGame game;
+	ChessBoard board;
+	FILE * file;
+	int fd, color, games = 0, j;
+	bool ok = true;
+
+	if((fd = mkstemp(name)) < 0 || (file = fdopen(fd, "w")) == NULL) {
+		fprintf(stderr, "Could not create %s\n", name);
+		return false;
+	}
+	fputs(check_pgn, file);
+	fclose(file);
+
+	if(!reader.open(name)) {
+		fprintf(stderr, "Could not open %s\n", name);
+		unlink(name);
+		return false;
+	}
+
+	for(; reader.readGame(game); games++)
+	{
+		if(games >= (int)(sizeof(check_plies) / sizeof(check_plies[0]))
+			|| game.getMoveCount() != check_plies[games]) {
+			printf("Game %d: %d plies read\n", games + 1, game.getMoveCount());
+			ok = false;
+			continue;
+		}
+
+		game.getStartPosition(board, color);
+		for(j = 0; j < game.getMoveCount(); j++)
+		{
+			if(!playSAN(board, color, game.getMove(j))) {
+				printf("Game %d: no legal move %s at ply %d\n", games + 1, game.getMove(j), j + 1);
+				ok = false;
+				break;
+			}
+		}
+	}
+
+	reader.close();
+	unlink(name);
+
+	if(games != (int)(sizeof(check_plies) / sizeof(check_plies[0])))
+		ok = false;
+
+	printf("%d sample games %s\n", games, ok ? "OK" : "FAILED");
+	return ok;
+}
+
+int main(int argc, char ** argv)
+{
+	const char * write_name = NULL, * fen_name = NULL, * white, * black;
+	vector<const char *> inputs;
+	FILE * write_file = NULL, * fen_file = NULL;
+	PGNGame game, written;
+	PGNReader reader;
+	ChessBoard board;
+	Move move;
+	char san[SAN_LENGTH], fen[FEN_LENGTH];
+	long games = 0, moves = 0, errors = 0, number;
+	int color, i, j;
+	bool quiet = false;
+	double seconds;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-write") == 0 && i + 1 < argc)
+			write_name = argv[++i];
+		else if(strcmp(argv[i], "-fen") == 0 && i + 1 < argc)
+			fen_name = argv[++i];
+		else if(strcmp(argv[i], "-quiet") == 0)
+			quiet = true;
+		else if(strcmp(argv[i], "-check") == 0)
+			return checkSamples() ? 0 : 1;
+		else if(argv[i][0] != '-' || strcmp(argv[i], "-") == 0)
+			inputs.push_back(argv[i]);
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	if(inputs.empty()) {
+		usage();
+		return 1;
+	}
+
+	if(write_name && (write_file = fopen(write_name, "w")) == NULL) {
+		fprintf(stderr, "Could not open %s\n", write_name);
+		return 1;
+	}
+
+	if(fen_name && (fen_file = fopen(fen_name, "w")) == NULL) {
+		fprintf(stderr, "Could not open %s\n", fen_name);
+		return 1;
+	}
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	for(i = 0; i < (int)inputs.size(); i++)
+	{
+		if(!reader.open(inputs[i])) {
+			fprintf(stderr, "Could not open %s\n", inputs[i]);
+			return 1;
+		}
+
+		for(number = 1; reader.readGame(game); number++)
+		{
+			games++;
+
+			if(!game.getStartPosition(board, color)) {
+				errors++;
+				if(!quiet)
+					fprintf(stderr, "%s: game %ld: malformed FEN\n", inputs[i], number);
+				continue;
+			}
+
+			// same tags, the moves are added as they are replayed
+			if(write_file) {
+				written = game;
+				written.clearMoves();
+			}
+
+			for(j = 0; j < game.getMoveCount(); j++)
+			{
+				// the SAN of the engine is found before the move is made
+				if(write_file && parseSAN(board, color, game.getMove(j), move)) {
+					toSAN(board, color, move, san);
+					written.addMove(san);
+				}
+
+				if(!playSAN(board, color, game.getMove(j))) {
+					errors++;
+					if(!quiet) {
+						white = game.getTag("White");
+						black = game.getTag("Black");
+						fprintf(stderr, "%s: game %ld (%s - %s): no legal move %s at ply %d\n",
+							inputs[i], number, white ? white : "?", black ? black : "?",
+							game.getMove(j), j + 1);
+					}
+					break;
+				}
+
+				moves++;
+
+				if(fen_file && game.result != "*" && !game.result.empty()) {
+					board.toFEN(color, fen);
+					fprintf(fen_file, "%s %s\n", fen, game.result.c_str());
+				}
+			}
+
+			// games with errors are left out
+			if(write_file && written.getMoveCount() == game.getMoveCount())
+				writePGN(write_file, written);
+		}
+
+		reader.close();
+	}
+
+	seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	printf("%ld games, %ld moves, %ld errors in %.2f s, %.0f moves/s\n",
+		games, moves, errors, seconds, moves / (seconds > 0 ? seconds : 1));
+
+	if(write_file)
+		fclose(write_file);
+	if(fen_file)
+		fclose(fen_file);
+
+	return 0;
+}
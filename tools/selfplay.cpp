@@ -0,0 +1,101 @@
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include "match.h"
+
+using namespace std;
+
+static void usage(void)
+{
+	printf("Usage: selfplay [options]\n\n"
+		"  -depth1 N          search depth of the first engine (default 3)\n"
+		"  -depth2 N          search depth of the second engine (default 3)\n"
+		"  -tc BASE+INC       clock of both engines in seconds instead of depths\n"
+		"  -games N           number of games to play (default 100)\n"
+		"  -concurrency N     games played in parallel (default: all cores)\n"
+		"  -openings FILE     opening positions, one FEN per line\n"
+		"  -maxplies N        adjudicate longer games as draws (default 400)\n"
+		"  -sprt ELO0 ELO1    stop early once H0 or H1 is accepted\n"
+		"  -alpha A -beta B   SPRT error probabilities (default 0.05)\n"
+		"  -seed N            seed of the match, the games are derived from it\n"
+		"                     (default: time)\n");
+}
+
+int main(int argc, char ** argv)
+{
+	EngineConfig first, second;
+	const char * openings = NULL;
+	int games = 100, threads, max_plies = 400, i;
+	double elo0 = 0.0, elo1 = 5.0, alpha = 0.05, beta = 0.05, base, inc = 0.0;
+	unsigned int seed = 0;
+	bool sprt = false, seeded = false;
+
+	first.search_depth = 3;
+	second.search_depth = 3;
+	first.time = second.time = 0;
+	first.increment = second.increment = 0;
+
+	if((threads = thread::hardware_concurrency()) < 1)
+		threads = 1;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-depth1") == 0 && i + 1 < argc)
+			first.search_depth = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-depth2") == 0 && i + 1 < argc)
+			second.search_depth = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-tc") == 0 && i + 1 < argc) {
+			if(sscanf(argv[++i], "%lf+%lf", &base, &inc) < 1) {
+				usage();
+				return 1;
+			}
+			first.time = second.time = (int)(base * 1000);
+			first.increment = second.increment = (int)(inc * 1000);
+		}
+		else if(strcmp(argv[i], "-games") == 0 && i + 1 < argc)
+			games = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-concurrency") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-openings") == 0 && i + 1 < argc)
+			openings = argv[++i];
+		else if(strcmp(argv[i], "-maxplies") == 0 && i + 1 < argc)
+			max_plies = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-sprt") == 0 && i + 2 < argc) {
+			elo0 = atof(argv[++i]);
+			elo1 = atof(argv[++i]);
+			sprt = true;
+		}
+		else if(strcmp(argv[i], "-alpha") == 0 && i + 1 < argc)
+			alpha = atof(argv[++i]);
+		else if(strcmp(argv[i], "-beta") == 0 && i + 1 < argc)
+			beta = atof(argv[++i]);
+		else if(strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+			seed = strtoul(argv[++i], NULL, 10);
+			seeded = true;
+		}
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	Match match(first, second);
+
+	if(openings && match.loadOpenings(openings) <= 0) {
+		fprintf(stderr, "Could not read openings from %s\n", openings);
+		return 1;
+	}
+
+	if(sprt)
+		match.setSPRT(elo0, elo1, alpha, beta);
+
+	if(seeded)
+		match.setSeed(seed);
+
+	match.setMaxPlies(max_plies);
+	match.run(games, threads > 0 ? threads : 1);
+	match.printResult();
+
+	return 0;
+}
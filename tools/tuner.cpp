@@ -0,0 +1,481 @@
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "chessboard.h"
+#include "evalparams.h"
+#include "mappedfile.h"
+#include "trainingdata.h"
+
+using namespace std;
+
+// Tuned parameters, in the order of the features
+#define PARAMS 5
+
+// Features are padded to this, so the dot products fill vector registers
+#define FEATURES 8
+
+static const char * param_names[PARAMS] = {
+	"PAWN_VALUE", "ROOK_VALUE", "KNIGHT_VALUE", "BISHOP_VALUE", "QUEEN_VALUE"
+};
+
+static const char * param_comments[PARAMS] = {
+	"8x", "2x", "2x", "2x", "1x"
+};
+
+static const int param_pieces[PARAMS] = {
+	PAWN, ROOK, KNIGHT, BISHOP, QUEEN
+};
+
+/*
+* A position reduced to what the evaluation looks at: per parameter the
+* number of white minus black pieces, and the result of the game for white
+* in half points.
+*/
+struct Sample
+{
+	int8_t features[FEATURES];
+	uint8_t result;		// 0, 1 or 2
+};
+
+/*
+* Loss and its gradient summed over a range of samples
+*/
+struct Partial
+{
+	double loss;
+	double gradient[FEATURES];
+};
+
+static void usage(void)
+{
+	printf("Usage: tuner [options] FILE...\n\n"
+		"A FILE holds one position per line, a FEN followed by the result of the\n"
+		"game: 1-0, 0-1, 1/2-1/2 or [1.0], [0.0], [0.5]. Files ending in .bin are\n"
+		"training records as written by datagen.\n\n"
+		"  -iterations N      gradient descent steps (default 2000)\n"
+		"  -rate R            learning rate (default 1.0)\n"
+		"  -threads N         threads computing the loss (default: all cores)\n"
+		"  -out FILE          header to write (default ../engine/evalparams.h)\n");
+}
+
+/*
+* Game result in half points for white, -1 if the line has none
+*/
+static int parseResult(const char * line)
+{
+	if(strstr(line, "1/2-1/2") || strstr(line, "[0.5]"))
+		return 1;
+	if(strstr(line, "1-0") || strstr(line, "[1.0]") || strstr(line, "[1]"))
+		return 2;
+	if(strstr(line, "0-1") || strstr(line, "[0.0]") || strstr(line, "[0]"))
+		return 0;
+
+	return -1;
+}
+
+/*
+* Read all positions of the file. Returns false if it cannot be opened.
+*/
+static bool load(const char * filename, vector<Sample> & samples)
+{
+	char line[512];
+	ChessBoard board;
+	Sample sample;
+	int color, result, pos, i, figure;
+	long skipped = 0;
+	FILE * file;
+
+	if((file = fopen(filename, "r")) == NULL)
+		return false;
+
+	while(fgets(line, sizeof(line), file))
+	{
+		if((result = parseResult(line)) < 0 || !board.initFEN(line, color)) {
+			skipped++;
+			continue;
+		}
+
+		memset(&sample, 0, sizeof(sample));
+		sample.result = result;
+
+		for(pos = 0; pos < 64; pos++)
+		{
+			figure = board.square[pos];
+			for(i = 0; i < PARAMS; i++)
+				if(FIGURE(figure) == param_pieces[i])
+					sample.features[i] += IS_BLACK(figure) ? -1 : 1;
+		}
+
+		samples.push_back(sample);
+	}
+
+	fclose(file);
+
+	if(skipped)
+		fprintf(stderr, "Skipped %ld lines without position or result\n", skipped);
+
+	return true;
+}
+
+/*
+* Add the positions of a file of training records. The records are read
+* in place and the piece codes counted without unpacking the boards.
+* Returns false if it cannot be opened.
+*/
+static bool loadRecords(const char * filename, vector<Sample> & samples)
+{
+	RecordFile<TrainingRecord> records;
+	ChessBoard board;
+	Sample sample;
+	long damaged = 0;
+	int count, code, color, i, j;
+
+	if(!records.open(filename))
+		return false;
+
+	samples.reserve(samples.size() + records.size());
+
+	for(const TrainingRecord * it = records.begin(); it != records.end(); ++it)
+	{
+		// records that do not unpack to a position are left out
+		if(!board.initPacked(it->board, color)) {
+			damaged++;
+			continue;
+		}
+
+		memset(&sample, 0, sizeof(sample));
+
+		// the records keep the result for the side to move
+		sample.result = (it->board.flags & PACKED_BLACK) ? 2 - it->result : it->result;
+
+		count = __builtin_popcountll(it->board.occupancy);
+		for(i = 0; i < count && i < 32; i++)
+		{
+			code = (it->board.pieces[i / 2] >> (4 * (i % 2))) & 0x0F;
+			for(j = 0; j < PARAMS; j++)
+				if((code & 0x07) == param_pieces[j])
+					sample.features[j] += (code & 0x08) ? -1 : 1;
+		}
+
+		samples.push_back(sample);
+	}
+
+	if(damaged > 0)
+		fprintf(stderr, "%s: %ld damaged records skipped\n", filename, damaged);
+
+	return true;
+}
+
+/*
+* Squared error of the predicted result against the real one for a range
+* of samples, and its gradient with respect to the parameters.
+*/
+static void evaluateRange(const vector<Sample> & samples, size_t begin, size_t end,
+	const float params[FEATURES], double k, bool gradient, Partial & partial)
+{
+	float eval, sigmoid, error, factor;
+	size_t i;
+	int j;
+
+	memset(&partial, 0, sizeof(partial));
+
+	for(i = begin; i < end; i++)
+	{
+		const Sample & sample = samples[i];
+
+		// same as evaluateBoard, a dot product of values and counts
+		eval = 0.0f;
+		for(j = 0; j < FEATURES; j++)
+			eval += params[j] * sample.features[j];
+
+		sigmoid = 1.0f / (1.0f + expf(-k * eval));
+		error = sample.result * 0.5f - sigmoid;
+		partial.loss += error * error;
+
+		if(gradient) {
+			factor = -2.0f * error * sigmoid * (1.0f - sigmoid) * k;
+			for(j = 0; j < FEATURES; j++)
+				partial.gradient[j] += factor * sample.features[j];
+		}
+	}
+}
+
+/*
+* Threads that compute the loss over a fixed share of the samples each,
+* started once for the whole run. The calling thread takes the first
+* share, so one thread needs no workers at all.
+*/
+class LossPool
+{
+	public:
+
+		LossPool(const vector<Sample> & samples, int threads) :
+		 samples(samples),
+		 partials(threads),
+		 chunk((samples.size() + threads - 1) / threads),
+		 params(NULL),
+		 k(0.0),
+		 gradient(false),
+		 round(0),
+		 pending(0),
+		 quit(false)
+		{
+			for(int t = 1; t < threads; t++)
+				workers.push_back(thread(&LossPool::work, this, t));
+		}
+
+		~LossPool()
+		{
+			{
+				lock_guard<mutex> guard(lock);
+				quit = true;
+			}
+			start.notify_all();
+
+			for(size_t t = 0; t < workers.size(); t++)
+				workers[t].join();
+		}
+
+		/*
+		* Mean loss over all samples. The gradient is averaged too if
+		* asked for.
+		*/
+		double evaluate(const float params[FEATURES], double k, double * gradient)
+		{
+			double loss = 0.0;
+			size_t t;
+			int j;
+
+			{
+				lock_guard<mutex> guard(lock);
+				this->params = params;
+				this->k = k;
+				this->gradient = gradient != NULL;
+				pending = workers.size();
+				round++;
+			}
+			start.notify_all();
+
+			evaluateShare(0);
+
+			{
+				unique_lock<mutex> guard(lock);
+				done.wait(guard, [this] { return pending == 0; });
+			}
+
+			if(gradient)
+				memset(gradient, 0, sizeof(double) * FEATURES);
+
+			for(t = 0; t < partials.size(); t++)
+			{
+				loss += partials[t].loss;
+				if(gradient)
+					for(j = 0; j < FEATURES; j++)
+						gradient[j] += partials[t].gradient[j] / samples.size();
+			}
+
+			return loss / samples.size();
+		}
+
+	protected:
+
+		void evaluateShare(int t)
+		{
+			size_t begin = min(samples.size(), t * chunk);
+			size_t end = min(samples.size(), begin + chunk);
+
+			evaluateRange(samples, begin, end, params, k, gradient, partials[t]);
+		}
+
+		/*
+		* Waits for a round, computes its share and reports it done
+		*/
+		void work(int t)
+		{
+			unsigned long seen = 0;
+
+			for(;;)
+			{
+				{
+					unique_lock<mutex> guard(lock);
+					start.wait(guard, [this, seen] { return quit || round != seen; });
+					if(quit)
+						return;
+					seen = round;
+				}
+
+				evaluateShare(t);
+
+				lock_guard<mutex> guard(lock);
+				if(--pending == 0)
+					done.notify_one();
+			}
+		}
+
+		const vector<Sample> & samples;
+		vector<Partial> partials;
+		vector<thread> workers;
+		size_t chunk;
+
+		// the current round, guarded by lock
+		mutex lock;
+		condition_variable start, done;
+		const float * params;
+		double k;
+		bool gradient;
+		unsigned long round;
+		int pending;
+		bool quit;
+};
+
+/*
+* Scaling of evaluations to win probabilities that fits the data best for
+* the given parameters.
+*/
+static double fitScaling(LossPool & pool, const float params[FEATURES])
+{
+	double k, best_k = 0.0, loss, best = 1e9;
+
+	// steps of 2% over the range of sensible scalings
+	for(k = 0.0001; k < 1.0; k *= 1.02)
+	{
+		if((loss = pool.evaluate(params, k, NULL)) < best) {
+			best = loss;
+			best_k = k;
+		}
+	}
+
+	return best_k;
+}
+
+/*
+* Write the parameters in the format of evalparams.h
+*/
+static bool writeHeader(const char * filename, const float params[FEATURES],
+	size_t positions, double loss)
+{
+	FILE * file;
+	int i;
+
+	if((file = fopen(filename, "w")) == NULL)
+		return false;
+
+	fprintf(file, "#ifndef EVAL_PARAMS_H_INCLUDED\n"
+		"#define EVAL_PARAMS_H_INCLUDED\n\n"
+		"// Evaluation parameters. Generated by tools/tuner from %lu positions,\n"
+		"// loss %.6f.\n\n", (unsigned long)positions, loss);
+
+	for(i = 0; i < PARAMS; i++)
+		fprintf(file, "#define %-13s%4d\t// %s\n", param_names[i],
+			(int)lrintf(params[i]), param_comments[i]);
+
+	fprintf(file, "\n#endif\n");
+	fclose(file);
+
+	return true;
+}
+
+int main(int argc, char ** argv)
+{
+	const char * output = "../engine/evalparams.h";
+	vector<const char *> inputs;
+	int iterations = 2000, threads, i, j;
+	size_t len;
+	bool binary;
+	float params[FEATURES] = {
+		PAWN_VALUE, ROOK_VALUE, KNIGHT_VALUE, BISHOP_VALUE, QUEEN_VALUE, 0, 0, 0
+	};
+	double rate = 1.0, k, loss, gradient[FEATURES];
+	double m[FEATURES] = { 0 }, v[FEATURES] = { 0 };
+	vector<Sample> samples;
+
+	if((threads = thread::hardware_concurrency()) < 1)
+		threads = 1;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-iterations") == 0 && i + 1 < argc)
+			iterations = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-rate") == 0 && i + 1 < argc)
+			rate = atof(argv[++i]);
+		else if(strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+			threads = max(1, atoi(argv[++i]));
+		else if(strcmp(argv[i], "-out") == 0 && i + 1 < argc)
+			output = argv[++i];
+		else if(argv[i][0] != '-')
+			inputs.push_back(argv[i]);
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	if(inputs.empty()) {
+		usage();
+		return 1;
+	}
+
+	for(i = 0; i < (int)inputs.size(); i++)
+	{
+		len = strlen(inputs[i]);
+		binary = len > 4 && strcmp(inputs[i] + len - 4, ".bin") == 0;
+
+		if(!(binary ? loadRecords(inputs[i], samples) : load(inputs[i], samples))) {
+			fprintf(stderr, "Could not read positions from %s\n", inputs[i]);
+			return 1;
+		}
+	}
+
+	if(samples.empty()) {
+		fprintf(stderr, "No positions found\n");
+		return 1;
+	}
+
+	printf("%lu positions, %lu bytes\n", (unsigned long)samples.size(),
+		(unsigned long)(samples.size() * sizeof(Sample)));
+
+	LossPool pool(samples, threads);
+
+	// the scaling stays fixed, otherwise all values could grow together
+	k = fitScaling(pool, params);
+	loss = pool.evaluate(params, k, NULL);
+	printf("Scaling %.3f, initial loss %.6f\n", k, loss);
+
+	// Adam steps, they cope with parameters of different magnitude
+	for(i = 1; i <= iterations; i++)
+	{
+		loss = pool.evaluate(params, k, gradient);
+
+		for(j = 0; j < PARAMS; j++)
+		{
+			m[j] = 0.9 * m[j] + 0.1 * gradient[j];
+			v[j] = 0.999 * v[j] + 0.001 * gradient[j] * gradient[j];
+			params[j] -= rate * (m[j] / (1.0 - pow(0.9, i)))
+				/ (sqrt(v[j] / (1.0 - pow(0.999, i))) + 1e-8);
+		}
+
+		if(i % 100 == 0 || i == iterations) {
+			printf("Iteration %d, loss %.6f:", i, loss);
+			for(j = 0; j < PARAMS; j++)
+				printf(" %.1f", params[j]);
+			printf("\n");
+		}
+	}
+
+	loss = pool.evaluate(params, k, NULL);
+
+	if(!writeHeader(output, params, samples.size(), loss)) {
+		fprintf(stderr, "Could not write %s\n", output);
+		return 1;
+	}
+
+	printf("Wrote %s\n", output);
+
+	return 0;
+}